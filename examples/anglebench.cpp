@@ -0,0 +1,72 @@
+// *********************************
+// SNDrift: helium scattering angle benchmark
+//**********************************
+
+#include <iostream>
+#include <chrono>
+
+// us
+#include "wentzel.hh"
+#include "philox.hh"
+#include "getopt_pp.h"
+
+// ROOT
+#include "TVector3.h"
+#include "TMath.h"
+
+void showHelp() {
+  std::cout << "scattering angle benchmark command line option(s) help" << std::endl;
+  std::cout << "\t -n , --nsamples <number of scatterings>" << std::endl;
+}
+
+
+
+int main(int argc, char** argv) {
+  int nsamples;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('n', "nsamples", nsamples, 10000000);
+
+  WentzelTable table;
+  std::cout << "table max |cos| deviation from analytic: " << table.maxError() << std::endl;
+
+  // analytic angle and spherical coordinate round trip
+  Philox rng(0, 0, 0, 0);
+  TVector3 vel(1.0e6, 0.0, 0.0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i=0;i<nsamples;i++) {
+    double energy = 40.0 * rng.Rndm();
+    double theta = TMath::ACos(WentzelTable::analytic(energy, rng.Rndm()));
+    double phi0 = vel.Phi();
+    vel.SetTheta(TMath::Pi()/2.0);
+    vel.SetPhi(theta+phi0);
+  }
+  double told = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "analytic + SetTheta/SetPhi: " << 1.e9*told/nsamples << " ns per scattering (" << vel.X() << ")" << std::endl;
+
+  // table and plane rotation
+  Philox rng2(0, 0, 0, 0);
+  double vx = 1.0e6;
+  double vy = 0.0;
+  double costh, sinth;
+  start = std::chrono::steady_clock::now();
+  for (int i=0;i<nsamples;i++) {
+    double energy = 40.0 * rng2.Rndm();
+    table.sample(energy, rng2.Rndm(), costh, sinth);
+    double vxy = TMath::Sqrt(vx*vx + vy*vy);
+    double cphi = vx / vxy;
+    double sphi = vy / vxy;
+    vx = vxy * (cphi*costh - sphi*sinth);
+    vy = vxy * (sphi*costh + cphi*sinth);
+  }
+  double tnew = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "table + rotation: " << 1.e9*tnew/nsamples << " ns per scattering (" << vx << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,216 @@
+// *********************************
+// SNDrift: field map validation and
+// lookup benchmark
+//**********************************
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// us
+#include "fields.hh"
+#include "fieldmap.hh"
+#include "geomodel.hh"
+#include "getopt_pp.h"
+#include "philox.hh"
+
+void showHelp() {
+  std::cout << "field map validation command line option(s) help" << std::endl;
+  std::cout << "\t -n , --npoints <number of test points in the Comsol region>" << std::endl;
+  std::cout << "\t -g , --gridstep <uniform grid step [cm], 0: node spacing>" << std::endl;
+  std::cout << "\t -q , --tolerance <relative quadtree tolerance>" << std::endl;
+  std::cout << "\t -m , --budget <tiled grid memory budget per thread [MB]>" << std::endl;
+  std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
+  std::cout << "\t -d , --dataDir <FULL PATH Directory to data file>" << std::endl;
+}
+
+
+// test points and the KD-tree IDW reference values there
+struct sample_t {
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> ex;
+  std::vector<double> ey;
+};
+
+
+// deviation from the reference and lookup time of one backend
+void compare(std::string what, FieldMap* map, sample_t& ref) {
+  int n = ref.x.size();
+  double ex, ey;
+  double maxdev = 0.0;
+  double sumsq = 0.0;
+  double maxrel = 0.0;
+  for (int i=0;i<n;i++) {
+    map->field(ref.x[i], ref.y[i], ex, ey);
+    double dev = std::sqrt((ex-ref.ex[i])*(ex-ref.ex[i]) + (ey-ref.ey[i])*(ey-ref.ey[i]));
+    double mag = std::sqrt(ref.ex[i]*ref.ex[i] + ref.ey[i]*ref.ey[i]);
+    if (dev > maxdev) maxdev = dev;
+    if (mag > 0.0 && dev/mag > maxrel) maxrel = dev/mag;
+    sumsq += dev*dev;
+  }
+
+  double check = 0.0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i=0;i<n;i++) {
+    map->field(ref.x[i], ref.y[i], ex, ey);
+    check += ex;
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << what << ": max deviation [V/m] " << maxdev
+	    << " rms [V/m] " << std::sqrt(sumsq/n)
+	    << " max relative " << maxrel
+	    << " lookup [ns] " << 1.e9*elapsed/n
+	    << " memory [MB] " << map->memory()/1048576.0
+	    << " (" << check << ")" << std::endl;
+}
+
+
+
+int main(int argc, char** argv) {
+  int npoints;
+  double bias, gridstep, tolerance, budget;
+  std::string dataDirName;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('n', "npoints", npoints, 100000);
+  ops >> GetOpt::Option('g', "gridstep", gridstep, 0.0);
+  ops >> GetOpt::Option('q', "tolerance", tolerance, 0.01);
+  ops >> GetOpt::Option('m', "budget", budget, 64.0);
+  ops >> GetOpt::Option('b', "bias", bias, 1000.0);
+  ops >> GetOpt::Option('d', dataDirName, "");
+
+  if (dataDirName=="")
+    dataDirName = "data/";
+
+  std::string gfname = dataDirName+"trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname.data());
+
+  std::string femname = dataDirName+"sntracker_driftField.root";
+  ComsolFields* fem = new ComsolFields(femname.data());
+  fem->setBias(bias);
+  fem->read_fields();
+
+  KDTreeMap* kdmap = new KDTreeMap(fem);
+  double xmin, xmax, ymin, ymax;
+  kdmap->bounds(xmin, xmax, ymin, ymax);
+  std::cout << "mean node spacing [cm] " << kdmap->spacing() << std::endl;
+
+  // random points in the drift region, transport asks nowhere else
+  sample_t ref;
+  Philox rng(2, 0, 0, 0);
+  while ((int)ref.x.size() < npoints) {
+    double x = xmin + (xmax-xmin)*rng.Rndm();
+    double y = ymin + (ymax-ymin)*rng.Rndm();
+    if (gmodel->whereami(x, y, 0.0) != 1) continue;
+    double ex, ey;
+    kdmap->field(x, y, ex, ey);
+    ref.x.push_back(x);
+    ref.y.push_back(y);
+    ref.ex.push_back(ex);
+    ref.ey.push_back(ey);
+  }
+
+  compare("kd-tree idw", kdmap, ref);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  GridMap* grid = new GridMap(kdmap, gridstep);
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "uniform grid build [s] " << elapsed << std::endl;
+  compare("uniform grid", grid, ref);
+
+  // same grid, tiles filled at first use
+  start = std::chrono::steady_clock::now();
+  std::shared_ptr<FieldMap> lshared = fem->fieldMap(gmodel, lazy_grid, grid->getStep());
+  LazyGridMap* lazy = dynamic_cast<LazyGridMap*>(lshared.get());
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "lazy grid setup [s] " << elapsed << std::endl;
+  start = std::chrono::steady_clock::now();
+  double lazydev = 0.0;
+  for (unsigned int i=0;i<ref.x.size();i++) {
+    double gx, gy, lx, ly;
+    lazy->field(ref.x[i], ref.y[i], lx, ly);
+    grid->field(ref.x[i], ref.y[i], gx, gy);
+    lazydev = std::max(lazydev, std::fabs(lx-gx) + std::fabs(ly-gy));
+  }
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "lazy grid first pass [s] " << elapsed << " tiles built " << lazy->built()
+	    << " of " << lazy->tiles() << ", max difference to the grid [V/m] " << lazydev << std::endl;
+  compare("lazy grid, filled", lazy, ref);
+
+  start = std::chrono::steady_clock::now();
+  MeshMap* mesh = new MeshMap(fem);
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "triangle mesh build [s] " << elapsed << std::endl;
+  compare("triangle mesh, random order", mesh, ref);
+
+  start = std::chrono::steady_clock::now();
+  QuadTreeMap* qtree = new QuadTreeMap(mesh, gmodel, tolerance);
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "quadtree build [s] " << elapsed << " leaves " << qtree->leaves()
+	    << " depth " << qtree->getDepth() << std::endl;
+  compare("quadtree", qtree, ref);
+
+  fem->setTileBudget(budget);
+  start = std::chrono::steady_clock::now();
+  std::shared_ptr<FieldMap> tshared = fem->fieldMap(gmodel, tiled_grid, gridstep);
+  TileMap* tiles = dynamic_cast<TileMap*>(tshared.get()); // 0: fell back to the grid
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  unsigned long long hits = 0, misses = 0, evictions = 0;
+  if (tiles) {
+    std::cout << "tiled grid open [s] " << elapsed << " tiles " << tiles->tiles() << std::endl;
+    compare("tiled grid", tiles, ref);
+    tiles->tileStats(hits, misses, evictions);
+    std::cout << "  tile hits " << hits << " misses " << misses << " evictions " << evictions << std::endl;
+  }
+  else {
+    std::cout << "tiled grid: no tile map, grid in memory [s] " << elapsed << std::endl;
+    compare("tiled grid fallback", tshared.get(), ref);
+  }
+
+  // transport asks along a path, the walk starts next door
+  sample_t path;
+  double x = ref.x[0];
+  double y = ref.y[0];
+  while ((int)path.x.size() < npoints) {
+    double xn = x + 0.002*(rng.Rndm()-0.5); // [cm] about a free path
+    double yn = y + 0.002*(rng.Rndm()-0.5);
+    if (gmodel->whereami(xn, yn, 0.0) != 1) continue;
+    x = xn;
+    y = yn;
+    double ex, ey;
+    kdmap->field(x, y, ex, ey);
+    path.x.push_back(x);
+    path.y.push_back(y);
+    path.ex.push_back(ex);
+    path.ey.push_back(ey);
+  }
+  compare("kd-tree idw, path order", kdmap, path);
+  compare("triangle mesh, path order", mesh, path);
+  compare("quadtree, path order", qtree, path);
+  if (tiles) {
+    unsigned long long before = misses;
+    compare("tiled grid, path order", tiles, path);
+    tiles->tileStats(hits, misses, evictions);
+    std::cout << "  tile misses on the path " << misses - before << std::endl;
+  }
+
+  delete qtree;
+  delete mesh;
+  delete grid;
+  delete kdmap;
+  delete fem;
+  delete gmodel;
+
+  return 0;
+}
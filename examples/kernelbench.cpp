@@ -0,0 +1,200 @@
+// *********************************
+// SNDrift: per-collision cost benchmark
+//**********************************
+
+#include <list>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+// us
+#include "ctransport.hh"
+#include "electrode.hh"
+#include "fields.hh"
+#include "geomodel.hh"
+#include "getopt_pp.h"
+#include "utils.hh"
+#include "vec3.hh"
+#include "philox.hh"
+
+// ROOT
+#include "TVector3.h"
+#include "TMath.h"
+
+void showHelp() {
+  std::cout << "per-collision cost benchmark command line option(s) help" << std::endl;
+  std::cout << "\t -x , --xstart <x-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -y , --ystart <y-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -c , --ncharges <number of starter charges at x,y>" << std::endl;
+  std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
+  std::cout << "\t -n , --nflights <free flights for the kinematics loops>" << std::endl;
+  std::cout << "\t -d , --dataDir <FULL PATH Directory to data file>" << std::endl;
+}
+
+
+// free flight kinematics alone, old style with ROOT vectors
+double flights_tvector(int n, double& check) {
+  Philox rng(1, 0, 0, 0);
+  double eoverm = 1.759e11; // Coulomb / kg
+  TVector3 efield(-2.e4, 1.e3, 0.0); // [V/m]
+  TVector3 speed(1.e5, 0.0, 0.0);
+  TVector3 distance(0.0, 0.0, 0.0);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i=0;i<n;i++) {
+    double dt = -1.e-12*TMath::Log(rng.Rndm());
+    TVector3 dv = eoverm * efield * dt;
+    speed += dv;
+    distance += speed*dt;
+    if (speed.Mag2() > 1.e13) speed.SetMag(1.e5); // keep the numbers bounded
+  }
+  check = distance.X();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// same loop on the plain transport kernel types
+double flights_pod(int n, double& check) {
+  Philox rng(1, 0, 0, 0);
+  double eoverm = 1.759e11; // Coulomb / kg
+  vec3_t acc;
+  acc.set(-2.e4*eoverm, 1.e3*eoverm, 0.0); // [m/s^2]
+  vec3_t speed;
+  speed.set(1.e5, 0.0, 0.0);
+  vec3_t distance;
+  distance.set(0.0, 0.0, 0.0);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i=0;i<n;i++) {
+    double dt = -1.e-12*TMath::Log(rng.Rndm());
+    speed.add(acc, dt);
+    distance.add(speed, dt);
+    double v2 = speed.mag2();
+    if (v2 > 1.e13) { // keep the numbers bounded
+      double s = 1.e5 / TMath::Sqrt(v2);
+      speed.set(s*speed.x, s*speed.y, s*speed.z);
+    }
+  }
+  check = distance.x;
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+
+int main(int argc, char** argv) {
+  int ncharges, nflights;
+  double bias, xs, ys;
+  std::string dataDirName;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('x', "xstart", xs, 3.5);
+  ops >> GetOpt::Option('y', "ystart", ys, -2.9);
+  ops >> GetOpt::Option('c', "charges", ncharges, 8);
+  ops >> GetOpt::Option('b', "bias", bias, 1000.0);
+  ops >> GetOpt::Option('n', "nflights", nflights, 10000000);
+  ops >> GetOpt::Option('d', dataDirName, "");
+
+  if (dataDirName=="")
+    dataDirName = "data/";
+
+  // kinematics only, no tables, no field queries
+  double check;
+  double t = flights_tvector(nflights, check);
+  std::cout << "flight kinematics TVector3: " << 1.e9*t/nflights << " ns per flight (" << check << ")" << std::endl;
+  t = flights_pod(nflights, check);
+  std::cout << "flight kinematics vec3_t:   " << 1.e9*t/nflights << " ns per flight (" << check << ")" << std::endl;
+
+  // complete transport on one thread
+  charge_t hit;
+  hit.location = Point3(xs, ys, 0.0); // [cm] unit from root geometry
+  hit.charge = -1;
+  std::list<charge_t> hits;
+  for (int i=0; i<ncharges; i++) {
+    hit.chargeID = i;
+    hits.push_back(hit);
+  }
+
+  std::string gfname = dataDirName+"trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname.data());
+
+  std::string femname = dataDirName+"sntracker_driftField.root";
+  ComsolFields* fem = new ComsolFields(femname.data());
+  fem->setBias(bias);
+  fem->read_fields();
+
+  std::string fn = dataDirName+"trackergasCS.root";
+  Ctransport* ctr = new Ctransport(fn, 0);
+  ctr->setThreads(1);
+  Electrode* anode = new Electrode(fem, gmodel);
+  anode->initfields(); // not part of the timing
+  fem->releaseNodes(); // the map keeps what it uses
+
+  // with and without region checks skipped by the distance map,
+  // same seed and run: the skip must not change any charge
+  std::vector<double> skiptimes;
+  std::vector<Point3> skipplaces;
+  for (int skip=1;skip>=0;skip--) {
+    ctr->setSafetySkip(skip==1);
+    ctr->setRun(0);
+    ctr->resetCollisions();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ctr->ctransport(anode, hits);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    unsigned int nelectrons = ctr->getDriftTimes().size();
+
+    std::cout << "transport, 1 thread" << (skip ? ", safety skip" : ", every region check")
+	      << ": collisions " << ctr->getCollisions()
+	      << " flights " << ctr->getSteps()
+	      << " ns per collision " << 1.e9*elapsed/ctr->getCollisions()
+	      << " ns per flight " << 1.e9*elapsed/ctr->getSteps() << std::endl;
+    std::cout << "  region checks per electron " << (double)ctr->getGeometryChecks()/nelectrons
+	      << " skipped per electron " << (double)ctr->getGeometrySkips()/nelectrons << std::endl;
+    if (skip) {
+      skiptimes = ctr->getDriftTimes();
+      skipplaces = ctr->getLocations();
+    }
+  }
+
+  // per charge, both in stream order
+  std::vector<double> times = ctr->getDriftTimes();
+  std::vector<Point3> places = ctr->getLocations();
+  if (times.size()!=skiptimes.size())
+    std::cout << "Error: safety skip changed the electron count, " << skiptimes.size()
+	      << " against " << times.size() << std::endl;
+  else {
+    unsigned int ndiff = 0;
+    double dtmax = 0.0;
+    double drmax = 0.0;
+    for (unsigned int i=0;i<times.size();i++) {
+      double dt = TMath::Abs(times[i] - skiptimes[i]);
+      double dx = places[i].xc() - skipplaces[i].xc();
+      double dy = places[i].yc() - skipplaces[i].yc();
+      double dz = places[i].zc() - skipplaces[i].zc();
+      double dr = TMath::Sqrt(dx*dx + dy*dy + dz*dz);
+      if (dt>0.0 || dr>0.0) ndiff++;
+      dtmax = std::max(dtmax, dt);
+      drmax = std::max(drmax, dr);
+    }
+    std::cout << "safety skip against every check: electrons " << times.size()
+	      << " differing " << ndiff
+	      << " max time difference " << dtmax
+	      << " max end point distance [cm] " << drmax << std::endl;
+    if (ndiff>0)
+      std::cout << "Error: safety skip changed the transport" << std::endl;
+  }
+
+  delete anode;
+  delete ctr;
+  delete fem;
+  delete gmodel;
+
+  return 0;
+}
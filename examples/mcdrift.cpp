@@ -20,6 +20,7 @@
 #include "TFile.h"
 #include "TNtupleD.h"
 #include "TParameter.h"
+#include "TRandom3.h"
 
 void showHelp() {
   std::cout << "Monte-Carlo scan command line option(s) help" << std::endl;
@@ -28,6 +29,7 @@ void showHelp() {
   std::cout << "\t -c , --ncharges <number of starter charges at x,y>" << std::endl;
   std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
   std::cout << "\t -s , --seed <random number seed offset>" << std::endl;
+  std::cout << "\t -t , --threads <number of transport threads, 0: all>" << std::endl;
   std::cout << "\t -n , --nsim <number of Monte Carlo simulations>" << std::endl;
   std::cout << "\t -p , --pressure <tracker gas pressure [mbar]>" << std::endl;
   std::cout << "\t -d , --dataDir <FULL PATH Directory to data file>" << std::endl;
@@ -38,9 +40,9 @@ void showHelp() {
 
 int main(int argc, char** argv) {
   // function declare
-  void signal_calculation(int seed, int nsim, int ncharges, double bias, double xstart, double ystart, double pr, std::string data, std::string fname);
+  void signal_calculation(int seed, int nsim, int ncharges, int nthreads, double bias, double xstart, double ystart, double pr, std::string data, std::string fname);
 
-  int seed, nsim, ncharges;
+  int seed, nsim, ncharges, nthreads;
   double bias, xs, ys, pressure;
   std::string dataDirName;
   std::string outputFileName;
@@ -57,11 +59,17 @@ int main(int argc, char** argv) {
   ops >> GetOpt::Option('c', "charges", ncharges, 1);
   ops >> GetOpt::Option('b', "bias", bias, 1000.0);
   ops >> GetOpt::Option('s', "seed", seed, 0);
+  ops >> GetOpt::Option('t', "threads", nthreads, 0);
   ops >> GetOpt::Option('n', "nsim", nsim, 10);
   ops >> GetOpt::Option('p', "pressure", pressure, 1013.25);
   ops >> GetOpt::Option('d', dataDirName, "");
   ops >> GetOpt::Option('o', outputFileName, "");
 
+  if (nthreads<0) {
+    std::cout << "Error: number of threads must not be negative" << std::endl;
+    return 1;
+  }
+
   if (dataDirName=="")
     dataDirName = "data/";
 
@@ -69,14 +77,14 @@ int main(int argc, char** argv) {
     outputFileName = "drifttimes.root";
 
   //run the code
-  signal_calculation(seed, nsim, ncharges, bias, xs, ys, pressure, dataDirName, outputFileName);
+  signal_calculation(seed, nsim, ncharges, nthreads, bias, xs, ys, pressure, dataDirName, outputFileName);
   
   return 0;
 }
 
 
 
-void signal_calculation(int seed, int nsim, int ncharges, double bias, double xstart, double ystart, double pr, std::string dataDirName, std::string fname) {
+void signal_calculation(int seed, int nsim, int ncharges, int nthreads, double bias, double xstart, double ystart, double pr, std::string dataDirName, std::string fname) {
 
   TRandom3 rnd; // for starters only
   charge_t hit;
@@ -110,6 +118,7 @@ void signal_calculation(int seed, int nsim, int ncharges, double bias, double xs
   std::string fn = dataDirName+"trackergasCS.root";
   Ctransport* ctr = new Ctransport(fn, seed);
   ctr->setDensity(0.1664 * pr / 1013.25); // [kg/m^3]  pr [mbar] / NTP (295K) helium gas density
+  ctr->setThreads(nthreads);
   // setting up
 
   //----------------------------------------------------------
@@ -117,6 +126,8 @@ void signal_calculation(int seed, int nsim, int ncharges, double bias, double xs
   //----------------------------------------------------------
   fem->read_fields();
   Electrode* anode = new Electrode(fem, gmodel);
+  anode->initfields(); // the map is built now
+  fem->releaseNodes(); // the map keeps what it uses
 
   std::vector<double> timestore;
   for (int nn=0; nn<nsim; nn++) { // Monte Carlo loop
@@ -0,0 +1,102 @@
+// *********************************
+// SNDrift: task dispatch benchmark
+//**********************************
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+// us
+#include "thread_pool.hpp"
+#include "getopt_pp.h"
+
+typedef std::chrono::steady_clock bclock;
+
+void showHelp() {
+  std::cout << "task dispatch benchmark command line option(s) help" << std::endl;
+  std::cout << "\t -n , --ntasks <number of tasks to dispatch>" << std::endl;
+  std::cout << "\t -t , --threads <number of pool worker threads>" << std::endl;
+}
+
+
+// latency from submit to task start in [ns]
+long long dispatch(bclock::time_point submitted) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(bclock::now() - submitted).count();
+}
+
+
+void report(std::string what, std::vector<long long>& lat, double total) {
+  std::sort(lat.begin(), lat.end());
+  double sum = 0.0;
+  for (long long l : lat) sum += l;
+  std::cout << what << ": tasks " << lat.size()
+	    << " burst total [ms] " << total*1.e3
+	    << " mean latency [us] " << 1.e-3*sum/lat.size()
+	    << " median [us] " << 1.e-3*lat.at(lat.size()/2)
+	    << " 99% [us] " << 1.e-3*lat.at((99*lat.size())/100) << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+  int ntasks, nthreads;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('n', "ntasks", ntasks, 10000);
+  ops >> GetOpt::Option('t', "threads", nthreads, 4);
+  if (nthreads<1) {
+    std::cout << "Error: the pool needs at least one thread" << std::endl;
+    return 1;
+  }
+
+  std::vector<long long> lat;
+  std::vector<std::future<long long> > results;
+  std::vector<thread_pool::future<long long> > presults;
+  bclock::time_point start;
+  double burst;
+
+  // reference: one std::async thread per task, as the old pool did
+  // single task round trips for the latency
+  for (int i=0;i<ntasks;i++)
+    lat.push_back(std::async(std::launch::async, dispatch, bclock::now()).get());
+  // all tasks in flight for the throughput
+  start = bclock::now();
+  for (int i=0;i<ntasks;i++)
+    results.push_back(std::async(std::launch::async, dispatch, bclock::now()));
+  for (std::future<long long>& r : results) r.get();
+  burst = std::chrono::duration<double>(bclock::now() - start).count();
+  report("std::async per task", lat, burst);
+  results.clear();
+  lat.clear();
+
+  // fixed worker pool, same two measurements
+  thread_pool* pool = new thread_pool(nthreads);
+  for (int i=0;i<ntasks;i++)
+    lat.push_back(pool->async(dispatch, bclock::now()).get());
+  start = bclock::now();
+  for (int i=0;i<ntasks;i++)
+    presults.push_back(pool->async(dispatch, bclock::now()));
+  for (thread_pool::future<long long>& r : presults) r.get();
+  burst = std::chrono::duration<double>(bclock::now() - start).count();
+  report("thread_pool", lat, burst);
+
+  // idle behaviour: workers should park rather than burn cores
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  thread_pool::statistics st = pool->stats();
+  std::cout << "thread_pool idle: tasks run " << st.tasks
+	    << " parks " << st.parks
+	    << " wakeups " << st.wakeups
+	    << " idle time [s] " << st.idle_time << std::endl;
+  delete pool;
+
+  return 0;
+}
@@ -0,0 +1,173 @@
+// *********************************
+// SNDrift: drift times with compact
+// field map storage against double
+//**********************************
+
+#include <list>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// us
+#include "ctransport.hh"
+#include "electrode.hh"
+#include "fields.hh"
+#include "fieldmap.hh"
+#include "geomodel.hh"
+#include "getopt_pp.h"
+#include "utils.hh"
+#include "philox.hh"
+
+void showHelp() {
+  std::cout << "field storage accuracy command line option(s) help" << std::endl;
+  std::cout << "\t -x , --xstart <x-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -y , --ystart <y-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -c , --ncharges <number of starter charges at x,y>" << std::endl;
+  std::cout << "\t -g , --gridstep <uniform grid step [cm], 0: node spacing>" << std::endl;
+  std::cout << "\t -s , --seed <random number seed>" << std::endl;
+  std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
+  std::cout << "\t -t , --threads <number of threads, 0: all hardware threads>" << std::endl;
+  std::cout << "\t -d , --dataDir <FULL PATH Directory to data file>" << std::endl;
+}
+
+
+// drift times [s] of one storage mode, sorted
+struct result_t {
+  std::string what;
+  std::vector<double> times;
+  double seconds;
+  size_t bytes;
+};
+
+
+double mean(const std::vector<double>& v) {
+  double sum = 0.0;
+  for (double t : v) sum += t;
+  return sum / v.size();
+}
+
+
+double rms(const std::vector<double>& v) {
+  double m = mean(v);
+  double sum = 0.0;
+  for (double t : v) sum += (t-m)*(t-m);
+  return std::sqrt(sum / v.size());
+}
+
+
+double quantile(const std::vector<double>& v, double q) {
+  return v[(size_t)(q * (v.size()-1))];
+}
+
+
+// two sample Kolmogorov-Smirnov distance, both sorted
+double ksdistance(const std::vector<double>& a, const std::vector<double>& b) {
+  size_t i = 0, j = 0;
+  double d = 0.0;
+  while (i<a.size() && j<b.size()) {
+    double t = std::min(a[i], b[j]);
+    while (i<a.size() && a[i]<=t) i++;
+    while (j<b.size() && b[j]<=t) j++;
+    d = std::max(d, std::fabs((double)i/a.size() - (double)j/b.size()));
+  }
+  return d;
+}
+
+
+
+int main(int argc, char** argv) {
+  int ncharges, seed, nthreads;
+  double bias, xs, ys, gridstep;
+  std::string dataDirName;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('x', "xstart", xs, 3.5);
+  ops >> GetOpt::Option('y', "ystart", ys, -2.9);
+  ops >> GetOpt::Option('c', "charges", ncharges, 1000);
+  ops >> GetOpt::Option('g', "gridstep", gridstep, 0.0);
+  ops >> GetOpt::Option('s', "seed", seed, 1);
+  ops >> GetOpt::Option('b', "bias", bias, 1000.0);
+  ops >> GetOpt::Option('t', "threads", nthreads, 0);
+  ops >> GetOpt::Option('d', dataDirName, "");
+
+  if (nthreads<0) {
+    std::cout << "Error: number of threads must not be negative" << std::endl;
+    return 1;
+  }
+
+  if (dataDirName=="")
+    dataDirName = "data/";
+
+  charge_t hit;
+  hit.location = Point3(xs, ys, 0.0); // [cm] unit from root geometry
+  hit.charge = -1;
+  std::list<charge_t> hits;
+  for (int i=0; i<ncharges; i++) {
+    hit.chargeID = i;
+    hits.push_back(hit);
+  }
+
+  std::string gfname = dataDirName+"trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname.data());
+
+  std::string femname = dataDirName+"sntracker_driftField.root";
+  ComsolFields* fem = new ComsolFields(femname.data());
+  fem->setBias(bias);
+  fem->read_fields();
+
+  std::string fn = dataDirName+"trackergasCS.root";
+  const int modes[3] = {storage_double, storage_float, storage_int16};
+  const char* names[3] = {"double", "float", "16 bit"};
+  std::vector<result_t> results;
+  for (int m=0;m<3;m++) {
+    fem->setFieldStorage(modes[m]);
+    Electrode* anode = new Electrode(fem, gmodel);
+    anode->setFieldMethod(uniform_grid, gridstep);
+    anode->initfields(); // not part of the timing
+    std::shared_ptr<FieldMap> map = fem->fieldMap(gmodel, uniform_grid, gridstep); // the anode's
+
+    Ctransport* ctr = new Ctransport(fn, seed); // same random streams for every mode
+    ctr->setThreads(nthreads);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ctr->ctransport(anode, hits);
+    result_t r;
+    r.what = names[m];
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.times = ctr->getDriftTimes();
+    r.bytes = map->memory();
+    std::sort(r.times.begin(), r.times.end());
+    results.push_back(r);
+    delete ctr;
+    delete anode;
+  }
+
+  // distributions against the double precision map
+  result_t& ref = results[0];
+  for (result_t& r : results) {
+    std::cout << r.what << ": map [MB] " << r.bytes/1048576.0
+	      << " transport [s] " << r.seconds
+	      << " electrons " << r.times.size()
+	      << " mean [ns] " << 1.e9*mean(r.times) // [s] -> [ns]
+	      << " rms [ns] " << 1.e9*rms(r.times)
+	      << " median [ns] " << 1.e9*quantile(r.times, 0.5)
+	      << " 90% [ns] " << 1.e9*quantile(r.times, 0.9) << std::endl;
+    if (&r == &ref) continue;
+    std::cout << "  against double: mean shift [ns] " << 1.e9*(mean(r.times) - mean(ref.times))
+	      << " rms change [ns] " << 1.e9*(rms(r.times) - rms(ref.times))
+	      << " KS distance " << ksdistance(r.times, ref.times) << std::endl;
+  }
+
+  delete fem;
+  delete gmodel;
+
+  return 0;
+}
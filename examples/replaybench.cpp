@@ -0,0 +1,205 @@
+// *********************************
+// SNDrift: field lookups replayed along
+// recorded electron trajectories
+//**********************************
+
+#include <list>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+
+// Linux perf events
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// us
+#include "ctransport.hh"
+#include "electrode.hh"
+#include "fields.hh"
+#include "fieldmap.hh"
+#include "geomodel.hh"
+#include "getopt_pp.h"
+#include "utils.hh"
+
+void showHelp() {
+  std::cout << "trajectory replay benchmark command line option(s) help" << std::endl;
+  std::cout << "\t -x , --xstart <x-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -y , --ystart <y-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -c , --ncharges <number of starter charges at x,y>" << std::endl;
+  std::cout << "\t -r , --repeats <replays per map>" << std::endl;
+  std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
+  std::cout << "\t -d , --dataDir <FULL PATH Directory to data file>" << std::endl;
+}
+
+
+// passes queries on and keeps their positions,
+// for a transport on one thread only
+class RecordingMap : public FieldMap {
+ private:
+  std::shared_ptr<FieldMap> source;
+
+ public:
+  std::vector<double> x; // [cm]
+  std::vector<double> y;
+
+  RecordingMap(std::shared_ptr<FieldMap> src) : source(src) {}
+  void field(double px, double py, double& ex, double& ey) {
+    x.push_back(px);
+    y.push_back(py);
+    source->field(px, py, ex, ey);
+  }
+  size_t memory() {return source->memory();}
+};
+
+
+// last level cache misses of this thread, -1 without perf events
+class MissCounter {
+ private:
+  int fd;
+
+ public:
+  MissCounter() {
+    perf_event_attr pe;
+    std::memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = PERF_COUNT_HW_CACHE_MISSES;
+    pe.disabled = 1;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    fd = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+  }
+  ~MissCounter() {if (fd>=0) close(fd);}
+
+  void start() {
+    if (fd<0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  long long stop() {
+    if (fd<0) return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+    return count;
+  }
+};
+
+
+// the recorded queries in order, repeated
+void replay(std::string what, FieldMap* map, RecordingMap* rec, int repeats) {
+  int n = rec->x.size();
+  double ex, ey;
+  double check = 0.0;
+  MissCounter misses;
+  misses.start();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int r=0;r<repeats;r++)
+    for (int i=0;i<n;i++) {
+      map->field(rec->x[i], rec->y[i], ex, ey);
+      check += ex;
+    }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  long long count = misses.stop();
+
+  std::cout << what << ": lookup [ns] " << 1.e9*elapsed/((double)n*repeats)
+	    << " cache misses per lookup ";
+  if (count<0)
+    std::cout << "n/a";
+  else
+    std::cout << (double)count/((double)n*repeats);
+  std::cout << " memory [MB] " << map->memory()/1048576.0 << " (" << check << ")" << std::endl;
+}
+
+
+
+int main(int argc, char** argv) {
+  int ncharges, repeats;
+  double bias, xs, ys;
+  std::string dataDirName;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('x', "xstart", xs, 3.5);
+  ops >> GetOpt::Option('y', "ystart", ys, -2.9);
+  ops >> GetOpt::Option('c', "charges", ncharges, 20);
+  ops >> GetOpt::Option('r', "repeats", repeats, 3);
+  ops >> GetOpt::Option('b', "bias", bias, 1000.0);
+  ops >> GetOpt::Option('d', dataDirName, "");
+
+  if (dataDirName=="")
+    dataDirName = "data/";
+
+  std::string gfname = dataDirName+"trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname.data());
+
+  std::string femname = dataDirName+"sntracker_driftField.root";
+  ComsolFields* fem = new ComsolFields(femname.data());
+  fem->setBias(bias);
+  fem->read_fields(); // nodes in Hilbert curve order
+
+  // record the field queries of a transport on one thread
+  std::shared_ptr<FieldMap> kdmap = fem->fieldMap(gmodel, kdtree_idw, 0.0);
+  std::shared_ptr<RecordingMap> rec(new RecordingMap(kdmap));
+  fem->setFieldMap(kdtree_idw, -1.0, rec); // step -1: only this recording
+  Electrode* anode = new Electrode(fem, gmodel);
+  anode->setFieldMethod(kdtree_idw, -1.0);
+
+  charge_t hit;
+  hit.location = Point3(xs, ys, 0.0); // [cm] unit from root geometry
+  hit.charge = -1;
+  std::list<charge_t> hits;
+  for (int i=0; i<ncharges; i++) {
+    hit.chargeID = i;
+    hits.push_back(hit);
+  }
+  std::string fn = dataDirName+"trackergasCS.root";
+  Ctransport* ctr = new Ctransport(fn, 0);
+  ctr->setThreads(1);
+  ctr->ctransport(anode, hits);
+  std::cout << "recorded " << rec->x.size() << " field queries of "
+	    << ctr->getDriftTimes().size() << " electrons" << std::endl;
+
+  // same nodes in COMSOL export order
+  ComsolFields* femfile = new ComsolFields(femname.data());
+  femfile->setBias(bias);
+  femfile->setSpatialOrder(false);
+  femfile->read_fields();
+  KDTreeMap* kdfile = new KDTreeMap(femfile->nodes());
+
+  replay("kd-tree idw, export order", kdfile, rec.get(), repeats);
+  replay("kd-tree idw, Hilbert order", kdmap.get(), rec.get(), repeats);
+
+  KDTreeMap* kdcurve = new KDTreeMap(fem->nodes());
+  double xmin, xmax, ymin, ymax;
+  kdcurve->bounds(xmin, xmax, ymin, ymax);
+  GridMap* grid = new GridMap(kdcurve, 0.0);
+  replay("uniform grid, double, untiled", grid, rec.get(), repeats);
+  // same float tiles, only their order in memory differs
+  CompactGridMap* rgrid = new CompactGridMap(kdcurve, xmin, xmax, ymin, ymax, grid->getStep(), storage_float, false);
+  replay("float grid, row-major tiles", rgrid, rec.get(), repeats);
+  CompactGridMap* fgrid = new CompactGridMap(kdcurve, xmin, xmax, ymin, ymax, grid->getStep(), storage_float);
+  replay("float grid, Morton tiles", fgrid, rec.get(), repeats);
+
+  delete fgrid;
+  delete rgrid;
+  delete grid;
+  delete kdcurve;
+  delete kdfile;
+  delete femfile;
+  delete ctr;
+  delete anode;
+  delete fem;
+  delete gmodel;
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+// *********************************
+// SNDrift: thread scaling benchmark
+//**********************************
+
+#include <list>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+
+// us
+#include "ctransport.hh"
+#include "electrode.hh"
+#include "fields.hh"
+#include "geomodel.hh"
+#include "thread_pool.hpp"
+#include "getopt_pp.h"
+#include "utils.hh"
+
+void showHelp() {
+  std::cout << "thread scaling benchmark command line option(s) help" << std::endl;
+  std::cout << "\t -x , --xstart <x-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -y , --ystart <y-coordinate start [cm]>" << std::endl;
+  std::cout << "\t -c , --ncharges <number of starter charges at x,y>" << std::endl;
+  std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
+  std::cout << "\t -m , --maxthreads <largest thread count, doubling from 1>" << std::endl;
+  std::cout << "\t -s , --seed <random number seed offset>" << std::endl;
+  std::cout << "\t -k , --kmax <constant null collision majorant instead of energy bands>" << std::endl;
+  std::cout << "\t -d , --dataDir <FULL PATH Directory to data file>" << std::endl;
+}
+
+
+
+int main(int argc, char** argv) {
+  int seed, ncharges, maxthreads;
+  double bias, xs, ys;
+  std::string dataDirName;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('x', "xstart", xs, 3.5);
+  ops >> GetOpt::Option('y', "ystart", ys, -2.9);
+  ops >> GetOpt::Option('c', "charges", ncharges, 64);
+  ops >> GetOpt::Option('b', "bias", bias, 1000.0);
+  ops >> GetOpt::Option('m', "maxthreads", maxthreads, 64);
+  ops >> GetOpt::Option('s', "seed", seed, 0);
+  ops >> GetOpt::Option('d', dataDirName, "");
+  bool constant = (ops >> GetOpt::OptionPresent('k', "kmax"));
+
+  if (dataDirName=="")
+    dataDirName = "data/";
+
+  // same starter charges for every thread count
+  charge_t hit;
+  hit.location = Point3(xs, ys, 0.0); // [cm] unit from root geometry
+  hit.charge = -1;
+  std::list<charge_t> hits;
+  for (int i=0; i<ncharges; i++) {
+    hit.chargeID = i;
+    hits.push_back(hit);
+  }
+
+  std::string gfname = dataDirName+"trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname.data());
+
+  std::string femname = dataDirName+"sntracker_driftField.root";
+  ComsolFields* fem = new ComsolFields(femname.data());
+  fem->setBias(bias);
+  fem->read_fields();
+
+  std::string fn = dataDirName+"trackergasCS.root";
+  Ctransport* ctr = new Ctransport(fn, seed);
+  ctr->setAdaptiveMajorant(!constant);
+  Electrode* anode = new Electrode(fem, gmodel);
+  anode->initfields(); // not part of the timing
+  fem->releaseNodes(); // the map keeps what it uses
+
+  for (int nthreads=1; nthreads<=maxthreads; nthreads*=2) {
+    thread_pool* pool = new thread_pool(nthreads); // workers up before the clock
+    ctr->setThreadPool(pool);
+    ctr->setRun(0); // same random streams, same workload for every count
+    ctr->resetCollisions();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ctr->ctransport(anode, hits);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ctr->setThreadPool(0);
+    delete pool;
+
+    std::cout << "threads " << nthreads
+	      << " collisions " << ctr->getCollisions()
+	      << " time [s] " << elapsed
+	      << " collisions/s " << ctr->getCollisions() / elapsed
+	      << " null fraction " << ctr->getNullFraction() << std::endl;
+  }
+
+  delete anode;
+  delete ctr;
+  delete fem;
+  delete gmodel;
+
+  return 0;
+}
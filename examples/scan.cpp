@@ -28,6 +28,7 @@ void showHelp() {
   std::cout << "\t -b , --bias <Anode bias in Volt>" << std::endl;
   std::cout << "\t -p , --pressure <tracker gas pressure [mbar]>" << std::endl;
   std::cout << "\t -s , --seed <random number seed offset>" << std::endl;
+  std::cout << "\t -t , --threads <number of transport threads, 0: all>" << std::endl;
   std::cout << "\t -o , --outputFile <FULL PATH ROOT FILENAME>" << std::endl;
 }
 
@@ -35,9 +36,9 @@ void showHelp() {
 
 int main(int argc, char** argv) {
   // function declare
-  void signal_calculation(int seed, double bias, double xstart, double ystart, double pr, std::string fname);
+  void signal_calculation(int seed, int nthreads, double bias, double xstart, double ystart, double pr, std::string fname);
 
-  int seed;
+  int seed, nthreads;
   double bias, xs, ys, pressure;
   std::string outputFileName;
   GetOpt::GetOpt_pp ops(argc, argv);
@@ -53,20 +54,26 @@ int main(int argc, char** argv) {
   ops >> GetOpt::Option('b', "bias", bias, 1000.0);
   ops >> GetOpt::Option('p', "pressure", pressure, 1013.25);
   ops >> GetOpt::Option('s', "seed", seed, 0);
+  ops >> GetOpt::Option('t', "threads", nthreads, 0);
   ops >> GetOpt::Option('o', outputFileName, "");
 
+  if (nthreads<0) {
+    std::cout << "Error: number of threads must not be negative" << std::endl;
+    return 1;
+  }
+
   if (outputFileName=="")
     outputFileName = "avalanche.root";
 
   //run the code
-  signal_calculation(seed, bias, xs, ys, pressure, outputFileName);
+  signal_calculation(seed, nthreads, bias, xs, ys, pressure, outputFileName);
   
   return 0;
 }
 
 
 
-void signal_calculation(int seed, double bias, double xstart, double ystart, double pr, std::string fname) {
+void signal_calculation(int seed, int nthreads, double bias, double xstart, double ystart, double pr, std::string fname) {
 
   charge_t hit;
   Point3 loc(xstart, ystart, 0.0); // [cm] unit from root geometry
@@ -93,6 +100,7 @@ void signal_calculation(int seed, double bias, double xstart, double ystart, dou
   std::string fn = "data/trackergasCS.root";
   Ctransport* ctr = new Ctransport(fn, seed);
   ctr->setDensity(0.1664 * pr / 1013.25); // [kg/m^3]  pr [mbar] / NTP (295K) helium gas density
+  ctr->setThreads(nthreads);
   // setting up
 
   //----------------------------------------------------------
@@ -100,6 +108,8 @@ void signal_calculation(int seed, double bias, double xstart, double ystart, dou
   //----------------------------------------------------------
   fem->read_fields();
   Electrode* anode = new Electrode(fem, gmodel);
+  anode->initfields(); // the map is built now
+  fem->releaseNodes(); // the map keeps what it uses
 
   ctr->ctransport(anode, hits);
   // for (double tt : ctr->getDriftTimes())
@@ -0,0 +1,64 @@
+#ifndef SNDRIFT_CSCACHE_HH
+#define SNDRIFT_CSCACHE_HH
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// us
+#include "mappedfile.hh"
+
+// MagBoltz cross sections per gas: helium, ethanol, argon
+struct cs_table_t {
+  std::vector<double> energy; // [eV] bin energies, sorted
+  std::vector<double> el[3];  // [m^2] elastic
+  std::vector<double> inel[3]; // [m^2] ionization
+};
+
+// from the ROOT 'cs' ntuple of utils/cs2root.py, one pass
+bool read_cs_root(std::string fname, cs_table_t& cs);
+// from the MagBoltz text output (data/trackergasCS.txt)
+bool read_cs_magboltz(std::string fname, cs_table_t& cs);
+
+
+//***********************************
+// Binary cross section table. Mapped
+// read-only; valid while version, size
+// and mtime of the source match its
+// header, always for a standalone file
+// written without source.
+//***********************************
+class CSCache {
+ private:
+  struct header_t {
+    char magic[8];          // "SNDCSEC"
+    uint32_t version;
+    uint32_t nbins;
+    uint64_t source_size;   // [bytes], 0: standalone
+    int64_t source_mtime;   // [s]
+    uint64_t offset[7];     // energy, el[3], inel[3] from file start
+  };
+
+  MappedFile file;
+  const header_t* head;
+
+  const double* array(int k) {return (const double*)(file.data() + head->offset[k]);}
+
+ public:
+  // map cname if it is current for source, "" for no source
+  CSCache(std::string cname, std::string source);
+  ~CSCache() {;}
+
+  static const unsigned int version = 1;
+
+  bool valid() {return head!=0;}
+  int bins() {return head->nbins;}
+  const double* energy() {return array(0);} // [eV]
+  const double* elastic(int gas) {return array(1+gas);} // [m^2]
+  const double* inelastic(int gas) {return array(4+gas);}
+
+  // to a temporary and renamed; source "" for a standalone file
+  static bool write(std::string cname, std::string source, const cs_table_t& cs);
+};
+#endif
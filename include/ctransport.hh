@@ -5,14 +5,17 @@
 #include <vector>
 #include <string>
 #include <mutex>
-
-// ROOT
-#include "TRandom3.h"
-#include "TVector3.h"
+#include <condition_variable>
+#include <atomic>
 
 //local
 #include "utils.hh"
+#include "vec3.hh"
 #include "electrode.hh"
+#include "philox.hh"
+#include "wentzel.hh"
+
+class thread_pool;
 
 //***********************************
 // Charge signal class
@@ -25,33 +28,61 @@ class Ctransport {
   std::list<charge_t> charges;
   std::vector<double> times;
   std::vector<Point3> places;
+  std::vector<unsigned long long> order; // stream keys of results
   std::mutex mtx;
-  TRandom3* rnd;
-  std::vector<double> energybins;
+  std::mutex qmtx; // charge queue
+  std::condition_variable qcv;
+  unsigned int inflight; // charges in transport
+  unsigned int nthreads;
+  thread_pool* pool; // reused for all ctransport calls
+  bool ownpool;
+  std::atomic<unsigned long long> ncollisions;
+  std::atomic<unsigned long long> nsteps; // real and null collisions
+  std::atomic<unsigned long long> ntruncated; // flights stopped at majorant range
+  std::atomic<unsigned long long> ngeochecks; // region checks at real collisions
+  std::atomic<unsigned long long> ngeoskips; // checks saved by the safety distance
+  bool safetyskip; // skip region checks far from boundaries
+  double kmax; // constant majorant [m^3/s]
+  bool adaptive; // energy dependent majorant instead of kmax
+  std::vector<double> majorant; // [m^3/s] running max per energy cell
+  double majscale; // majorant cells per eV
+  unsigned int rngseed;
+  unsigned int nrun; // ctransport calls, part of the random key
+  std::vector<int> bingrid; // uniform energy grid -> energybins index
+  double gridscale; // grid cells per eV
+  double mixture[3]; // helium, ethanol, argon volume fractions
   std::vector<double> HeCSel; // three gas cross section containers
   std::vector<double> EthCSel;
   std::vector<double> ArCSel;
   std::vector<double> HeCSinel; // three gas cross section containers
   std::vector<double> EthCSinel;
   std::vector<double> ArCSinel;
+  WentzelTable wentzel; // helium scattering angles
 
   // used by task function
   void book_charge(charge_t q);
-  void book_time(double tt);
-  void book_place(Point3 loc);
+  void book_stop(charge_t& q, double tt, Point3 loc);
   void readCS(std::string csname);
-  int  findBin(double en);
-  double time_update(double tau);
-  double angle_function2(double energy);
-  double cross_section(double energy, int which, int &inel_flag);
-  double pick_target(std::vector<double> weight, int& which);
-  TVector3 speed_update(int charge, Point3 dfield, double time);
-  TVector3 d_update(TVector3 v0, double time);
-  TVector3 kin_factor2(TVector3 v0, double tm);
+  void makeBinGrid();
+  void makeTables();
+  void makeMajorants();
+  double flight_limit(const vec3_t& v0, const vec3_t& acc, double eceil);
+  void acceleration(vec3_t& acc, int charge, const Point3& dfield);
+  double lab_energy(const vec3_t& v);
+  void kin_factor2(vec3_t& v0, double tm, Philox& rng);
 
 
  protected:
+  std::vector<double> energybins;
+  static const int nprocess = 6; // (elastic, ionization) x gas
+  std::vector<double> cstable; // cumulative cross sections per bin
+  int  findBin(double en);
+  double majorant_rate(double elab);
+  double time_update(double tau, Philox& rng);
+  int collision_process(double energy, double speed, double u, double& kv);
+
   bool run(Electrode* electrode);
+  bool drain(Electrode* electrode);
   bool taskfunction(Electrode* electrode, charge_t q);
 
  public:
@@ -70,5 +101,26 @@ class Ctransport {
   std::vector<Point3> getLocations() {return places;}
   double getDensity() {return density;}
   void setDensity(double d) {density = d;};
+  // parallelism, 0 threads means all hardware threads
+  void setThreads(unsigned int n);
+  unsigned int getThreads() {return nthreads;}
+  void setThreadPool(thread_pool* p); // caller keeps ownership, 0: own pool again
+  // random key of the next transport call, counts up by one per call;
+  // the same seed and run repeat the same charge streams
+  void setRun(unsigned int n) {nrun = n;}
+  unsigned int getRun() {return nrun;}
+  unsigned long long getCollisions() {return ncollisions;}
+  unsigned long long getSteps() {return nsteps;}
+  unsigned long long getTruncations() {return ntruncated;}
+  double getNullFraction() {return (nsteps>0) ? 1.0 - (double)ncollisions/nsteps : 0.0;}
+  unsigned long long getGeometryChecks() {return ngeochecks;}
+  unsigned long long getGeometrySkips() {return ngeoskips;}
+  void resetCollisions() {ncollisions = 0; nsteps = 0; ntruncated = 0; ngeochecks = 0; ngeoskips = 0;}
+  // use the distance map to skip region checks, on by default
+  void setSafetySkip(bool flag) {safetyskip = flag;}
+  // gas volume fractions, normalised; between transport calls only
+  void setMixture(double he, double eth, double ar);
+  // null collision majorant, energy dependent or constant kmax
+  void setAdaptiveMajorant(bool flag) {adaptive = flag;}
 };
 #endif
@@ -1,8 +1,6 @@
 #ifndef SNDRIFT_WIRE_HH
 #define SNDRIFT_WIRE_HH
 
-#include <mutex>
-
 //local
 #include "utils.hh"
 #include "geomodel.hh"
@@ -22,8 +20,9 @@ class Electrode {
   // pointer to comsol fields for constructing fields
   ComsolFields* femfields;
 
-  Fields* field; // specific for each electrode, constructed at creation
-  std::mutex mtx;
+  Fields* field; // per electrode, the field map inside is shared (ComsolFields)
+  int method; // field interpolation, field_method_t
+  double step; // [cm] grid step or quadtree tolerance, 0 for defaults
 
  protected:
 
@@ -38,7 +37,13 @@ class Electrode {
   // access
   void initfields(); // out of constructor - takes time.
   bool isactive() {return active;}
-
-  Point3 getFieldValue(bool& analytic, Point3 p);
+  // field interpolation backend, before initfields
+  void setFieldMethod(int m, double s=0.0) {method = m; step = s;}
+  // geometry navigation for n worker threads, see GeometryModel
+  void setThreads(unsigned int n) {gm->setThreads(n);}
+
+  Point3 getFieldValue(bool& analytic, const Point3& p);
+  // safety [cm] distance without geometry checks, see Fields
+  Point3 getFieldValue(bool& analytic, const Point3& p, double& safety);
 };
 #endif
@@ -0,0 +1,73 @@
+#ifndef SNDRIFT_FIELDCACHE_HH
+#define SNDRIFT_FIELDCACHE_HH
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// us
+#include "mappedfile.hh"
+
+// COMSOL text export (x, y, ex, ey per line in [m], [V/m]) parsed
+// in nthreads chunks; skip header lines first, '%' lines anywhere.
+// Coordinates returned in [cm], fields unscaled.
+bool read_comsol_text(std::string fname, int nthreads, int skip,
+		      std::vector<double>& x, std::vector<double>& y,
+		      std::vector<double>& ex, std::vector<double>& ey);
+
+
+//***********************************
+// Binary field map cache file. Mapped
+// read-only, concurrent jobs share it
+// through the page cache. Valid while
+// version, size and mtime of the ROOT
+// source match its header, always for
+// a standalone file written without
+// source. Fields are stored without bias.
+//***********************************
+class FieldCache {
+ private:
+  struct header_t {
+    char magic[8];          // "SNDFMAP"
+    uint32_t version;
+    uint32_t nnodes;
+    uint64_t source_size;   // [bytes] of the ROOT file, 0: standalone
+    int64_t source_mtime;   // [s]
+    uint32_t ntriangles;    // Delaunay index, 6 ints each
+    int32_t start;          // walk start triangle
+    double helpers[6];      // enclosing triangle nodes x0,y0,x1,...
+    uint64_t offset[5];     // x, y, ex, ey, triangles from file start
+  };
+
+  MappedFile file;
+  const header_t* head;
+
+  const double* array(int k) {return (const double*)(file.data() + head->offset[k]);}
+
+ public:
+  // map cname if it is current for source, "" for no source
+  FieldCache(std::string cname, std::string source);
+  ~FieldCache() {;}
+
+  static const unsigned int version = 2; // 2: nodes in Hilbert curve order
+
+  bool valid() {return head!=0;}
+  int nodes() {return head->nnodes;}
+  const double* x() {return array(0);} // [cm]
+  const double* y() {return array(1);}
+  const double* ex() {return array(2);} // [V/m]
+  const double* ey() {return array(3);}
+  int triangles() {return head->ntriangles;}
+  const int* triangleData() {return (const int*)(file.data() + head->offset[4]);}
+  int triangleStart() {return head->start;}
+  const double* helpers() {return head->helpers;}
+
+  // write to a temporary and rename, readers never see half a file;
+  // source "" for a standalone file
+  static bool write(std::string cname, std::string source,
+		    const std::vector<double>& x, const std::vector<double>& y,
+		    const std::vector<double>& ex, const std::vector<double>& ey,
+		    const std::vector<int>& tris, int start, const double* helpers);
+};
+#endif
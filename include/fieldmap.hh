@@ -0,0 +1,350 @@
+#ifndef SNDRIFT_FIELDMAP_HH
+#define SNDRIFT_FIELDMAP_HH
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+// ROOT includes
+#include "TKDTree.h"
+
+//local
+#include "fields.hh"
+
+
+// interpolation backends for Fields
+enum field_method_t {kdtree_idw, uniform_grid, triangle_mesh, quadtree, tiled_grid, lazy_grid};
+// node value storage of the uniform grid
+enum field_storage_t {storage_double, storage_float, storage_int16};
+
+
+// node order along a Hilbert curve over the node box,
+// nodes close in space become close in memory
+std::vector<int> spatial_order(const std::vector<double>& x, const std::vector<double>& y);
+// v[i] = v[order[i]]
+void reorder(std::vector<double>& v, const std::vector<int>& order);
+// node bounding box [cm] and mean node spacing [cm]
+void node_bounds(const std::vector<double>& x, const std::vector<double>& y,
+		 double& xmin, double& xmax, double& ymin, double& ymax);
+double node_spacing(const std::vector<double>& x, const std::vector<double>& y);
+
+
+// node limit of the in-memory grids, 16M nodes = 256 MB in double
+const double grid_max_nodes = 16777216.0;
+
+//***********************************
+// Uniform grid over a box, cut in
+// square tiles of cells x cells or
+// not (cells 0); the node layout and
+// cell lookup of all grid maps.
+//***********************************
+struct grid_geometry_t {
+  int nx; // grid nodes in x
+  int ny;
+  int cells; // grid cells per tile side
+  int ntx; // tiles in x
+  int nty;
+  double x0; // lower left corner [cm]
+  double y0;
+  double step; // [cm]
+  double inverse; // 1/step
+
+  grid_geometry_t() : nx(0), ny(0), cells(0), ntx(0), nty(0),
+		      x0(0.0), y0(0.0), step(0.0), inverse(0.0) {}
+
+  // box [cm] at step [cm], made coarser until at most maxnodes, 0: any
+  void set(double xmin, double xmax, double ymin, double ymax,
+	   double st, int c=0, double maxnodes=0.0);
+  int tiles() const {return ntx*nty;}
+
+  // cell i,j of x,y and the position inside, clamped to the grid
+  void cell(double x, double y, int& i, int& j, double& fx, double& fy) const {
+    fx = (x - x0) * inverse;
+    fy = (y - y0) * inverse;
+    if (fx < 0.0) fx = 0.0;
+    if (fy < 0.0) fy = 0.0;
+    i = (int)fx;
+    j = (int)fy;
+    if (i > nx-2) i = nx-2;
+    if (j > ny-2) j = ny-2;
+    fx -= i;
+    fy -= j;
+    if (fx > 1.0) fx = 1.0;
+    if (fy > 1.0) fy = 1.0;
+  }
+};
+
+
+//***********************************
+// Field map interpolation interface,
+// 2D drift field at x,y in [cm].
+// Queries are read-only, safe to
+// call from any number of threads.
+//***********************************
+class FieldMap {
+ public:
+  virtual ~FieldMap() {;}
+
+  // drift field [V/m] at x,y [cm] in the Comsol region
+  virtual void field(double x, double y, double& ex, double& ey) = 0;
+  // bytes held by the map
+  virtual size_t memory() = 0;
+};
+
+
+//***********************************
+// Inverse distance weighting over the
+// 8 nearest COMSOL nodes, KD-tree search
+//***********************************
+class KDTreeMap : public FieldMap {
+ private:
+  int nnodes;
+  TKDTreeID* coordinates;
+  // node store, kept alive by this map
+  std::shared_ptr<const field_nodes_t> nodes;
+  const double* allx;
+  const double* ally;
+  const double* alldx;
+  const double* alldy;
+
+  void build(std::shared_ptr<const field_nodes_t> store);
+
+ public:
+  KDTreeMap(ComsolFields* fem);
+  KDTreeMap(std::shared_ptr<const field_nodes_t> store);
+  ~KDTreeMap();
+
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory();
+  // node bounding box [cm] and mean node spacing [cm]
+  void bounds(double& xmin, double& xmax, double& ymin, double& ymax);
+  double spacing();
+};
+
+
+//***********************************
+// Resampling on a uniform 2D grid,
+// bilinear interpolation, O(1) lookup.
+// Field components stored SoA.
+//***********************************
+class GridMap : public FieldMap {
+ private:
+  grid_geometry_t grid; // untiled
+  std::vector<double> gex; // [V/m] at nodes, x fastest
+  std::vector<double> gey;
+
+ public:
+  // step [cm], 0 takes the mean node spacing of the source
+  GridMap(KDTreeMap* source, double step);
+  ~GridMap() {;}
+
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory();
+  double getStep() {return grid.step;}
+};
+
+
+//***********************************
+// Delaunay triangulation of the COMSOL
+// nodes, linear (barycentric) FEM-like
+// interpolation. Point location walks
+// from the previous triangle of the
+// calling thread.
+//***********************************
+class MeshMap : public FieldMap {
+ private:
+  struct tri_t {
+    int v[3];  // vertices, counter-clockwise
+    int nb[3]; // neighbour opposite v[i], -1 at the outer hull
+  };
+
+  int nnodes; // real nodes, three enclosing helper nodes follow
+  // node store, shared with the other maps, not copied
+  std::shared_ptr<const field_nodes_t> nodes;
+  const double* allx; // [cm]
+  const double* ally;
+  const double* alldx; // [V/m]
+  const double* alldy;
+  double helperx[3]; // [cm] helper nodes nnodes..nnodes+2
+  double helpery[3];
+  std::vector<tri_t> tris;
+  int start; // any live triangle, walk start without a hint
+
+  double nodex(int i) const {return (i<nnodes) ? allx[i] : helperx[i-nnodes];}
+  double nodey(int i) const {return (i<nnodes) ? ally[i] : helpery[i-nnodes];}
+  void share(std::shared_ptr<const field_nodes_t> store);
+  double orient(int a, int b, double px, double py) const;
+  bool incircle(int t, double px, double py) const;
+  int locate(int t, double px, double py) const;
+  int lowest(int t, double px, double py) const;
+  void triangulate();
+  void adopt(const int* data, int ntri, int s, const double* helpers);
+
+ public:
+  MeshMap(ComsolFields* fem); // triangles from the field cache if present
+  // nodes [cm] with their field values [V/m]
+  MeshMap(const std::vector<double>& x, const std::vector<double>& y,
+	  const std::vector<double>& ex, const std::vector<double>& ey);
+  ~MeshMap() {;}
+
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory();
+  int triangles(); // live triangles between real nodes
+  // 6 ints per triangle slot, v then nb; helper node x,y pairs
+  void exportMesh(std::vector<int>& data, int& s, double* helpers);
+};
+
+
+//***********************************
+// Adaptive quadtree over the Comsol box,
+// cells split until bilinear interpolation
+// of the source meets a relative tolerance,
+// and graded down to the wire radius near
+// wires. Nodes and leaves in flat arrays.
+//***********************************
+class QuadTreeMap : public FieldMap {
+ private:
+  struct qnode_t {
+    int child; // first of four children, -1 for a leaf
+    int leaf;  // leaf index into corners
+  };
+
+  double x0; // root cell [cm]
+  double y0;
+  double width;
+  double height;
+  int depth; // deepest leaf
+  std::vector<qnode_t> nodes;
+  std::vector<double> corners; // 8 per leaf: ex, ey at the 4 corners
+  std::vector<wire_t> wires;
+
+  bool inwire(double x, double y);
+  double nearwire(double xl, double xh, double yl, double yh);
+  void build(FieldMap* source, double tol, int maxdepth);
+
+ public:
+  // tol: relative deviation allowed at the test points
+  QuadTreeMap(FieldMap* source, GeometryModel* gm, double tol=0.01, int maxdepth=16);
+  // box [cm] and wires given directly
+  QuadTreeMap(FieldMap* source, double xmin, double xmax, double ymin, double ymax,
+	      const std::vector<wire_t>& wl, double tol=0.01, int maxdepth=16);
+  ~QuadTreeMap() {;}
+
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory();
+  int leaves() {return corners.size() / 8;}
+  int getDepth() {return depth;}
+};
+
+
+//***********************************
+// Uniform grid as GridMap, kept on disk
+// in square tiles. Each thread maps the
+// tiles it touches on demand and unmaps
+// its least recently used ones beyond
+// a memory budget.
+//***********************************
+class TileMap : public FieldMap {
+ private:
+  struct tile_cache_t; // per thread, in fieldmap.cpp
+  struct tile_shared_t; // the caches of all threads
+  struct tile_owner_t; // the caches of one thread
+
+  int fd; // tile file, open for mapping
+  grid_geometry_t grid; // as in the file
+  double scale; // bias over the bias in the file
+  size_t tilebytes; // page aligned
+  size_t offset; // first tile
+  std::vector<int> slots; // file position of each tile, Morton order
+  size_t budget; // [bytes] mapped per thread
+  // held by the map and by every thread with a cache in it,
+  // a thread ending unmaps its tiles, the map ending all others
+  std::shared_ptr<tile_shared_t> shared;
+
+  tile_cache_t* mycache();
+  const double* tile(tile_cache_t* c, int k);
+
+ public:
+  // bias of the drift field wanted, budget [MB] per thread
+  TileMap(std::string fname, double bias, double budget);
+  ~TileMap();
+
+  // file made for source, with this step request and tile size
+  static bool current(std::string fname, std::string source, double step, int cells);
+  // sample map over the box [cm] at step [cm] into tiles of cells x cells;
+  // bias the map carries, step the request recorded for current()
+  static bool write(std::string fname, std::string source, FieldMap* map,
+		    double xmin, double xmax, double ymin, double ymax,
+		    double step, double request, int cells, double bias);
+
+  bool valid() {return fd>=0;}
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory(); // tiles mapped now, all live threads
+  int tiles() {return grid.tiles();}
+  double getStep() {return grid.step;}
+  // summed over threads: queries in a mapped tile, tiles mapped, unmapped
+  void tileStats(unsigned long long& hits, unsigned long long& misses, unsigned long long& evictions);
+};
+
+
+//***********************************
+// Uniform grid as GridMap in tiles,
+// each resampled from the source at
+// the first query inside it and then
+// published with a compare-and-swap.
+// Lookups take no lock.
+//***********************************
+class LazyGridMap : public FieldMap {
+ private:
+  std::shared_ptr<FieldMap> source; // any thread safe map
+  grid_geometry_t grid;
+  std::atomic<const double*>* table; // per tile, 0 until filled
+  std::atomic<int> nbuilt;
+
+  const double* fill(int k);
+
+ public:
+  // box [cm] to cover at step [cm]
+  LazyGridMap(std::shared_ptr<FieldMap> src, double xmin, double xmax, double ymin, double ymax,
+	      double step, int cells=32);
+  ~LazyGridMap();
+
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory(); // filled tiles only
+  int tiles() {return grid.tiles();}
+  int built() {return nbuilt.load();}
+  double getStep() {return grid.step;}
+};
+
+
+//***********************************
+// Uniform grid as GridMap with compact
+// node values: float (ex, ey) pairs, or
+// 16 bit integers scaled per tile of
+// 16 x 16 cells to the largest value.
+//***********************************
+class CompactGridMap : public FieldMap {
+ private:
+  int storage; // field_storage_t, float or int16
+  grid_geometry_t grid; // tiles of 16 x 16 cells
+  std::vector<int> slots; // storage position of each tile, Morton or row order
+  std::vector<float> fdata; // [V/m] pairs, tile after tile
+  std::vector<int16_t> qdata; // pairs in units of qscale
+  std::vector<float> qscale; // [V/m] per unit, per tile
+
+ public:
+  // box [cm] sampled from source at step [cm]; curve false
+  // stores the tiles row by row instead of along the Morton curve
+  CompactGridMap(FieldMap* source, double xmin, double xmax, double ymin, double ymax,
+		 double step, int storage, bool curve=true);
+  ~CompactGridMap() {;}
+
+  void field(double x, double y, double& ex, double& ey);
+  size_t memory();
+  double getStep() {return grid.step;}
+};
+#endif
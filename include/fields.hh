@@ -2,9 +2,11 @@
 #define SNDRIFT_FIELDS_HH
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
 
 // ROOT includes
-#include "TKDTree.h"
 #include "TString.h"
 
 //local
@@ -12,6 +14,18 @@
 #include "geomodel.hh"
 
 
+class FieldCache;
+class FieldMap;
+
+// COMSOL nodes, immutable once read,
+// shared by the maps built on them
+struct field_nodes_t {
+  std::vector<double> x; // [cm]
+  std::vector<double> y;
+  std::vector<double> ex; // [V/m] bias applied
+  std::vector<double> ey;
+};
+
 //***********************************
 // Field map classes
 //***********************************
@@ -21,23 +35,69 @@ class ComsolFields {
   double bias;
   // which ROOT file to read the weighting field
   TString fname;
-  std::vector<Point3> coords;
-  std::vector<Point3> dmap;
+  std::shared_ptr<const field_nodes_t> store;
+  // maps built so far, alive while an Electrode holds one
+  struct map_entry_t {
+    int method;
+    double step;
+    int storage;
+    int source; // lazy_grid: map filling the tiles
+    std::weak_ptr<FieldMap> map;
+  };
+  std::vector<map_entry_t> maps;
+  std::mutex maplock;
+  // binary copy of the ROOT file plus triangulation
+  std::string cachename;
+  bool usecache;
+  bool standalone; // fname is a converted .fmap, no ROOT file
+  FieldCache* fcache;
+  double tilebudget; // [MB] per thread for tiled_grid
+  int lazysource; // field_method_t filling lazy_grid tiles
+  int storage; // field_storage_t of uniform_grid nodes
+  bool spatial; // nodes in Hilbert curve order, not COMSOL export order
+
+  std::shared_ptr<FieldMap> shared_map(GeometryModel* gm, int method, double step);
+  int lazy_source(int method); // lazy_grid tile source, kdtree_idw otherwise
+  FieldMap* build_map(GeometryModel* gm, int method, double step);
 
  protected:
 
  public:
   // Constructor
-  ComsolFields(TString fname); // from file
+  ComsolFields(TString fname); // from file, ROOT or .fmap
   
   // Default destructor
-  ~ComsolFields() {;}
+  ~ComsolFields();
 
   // Methods
   void read_fields();
   void setBias(double b) {bias = b;};
-  std::vector<Point3> positions() {return coords;}
-  std::vector<Point3> driftmap() {return dmap;}
+  // default: fname with .fmap appended, rebuilt when fname changes
+  void setCacheFile(std::string c) {cachename = c;}
+  void useCache(bool c) {usecache = c;}
+  FieldCache* cache() {return fcache;} // 0 without a current cache
+  // tiles each thread keeps mapped, for maps built after this
+  void setTileBudget(double mb) {tilebudget = mb;}
+  // kdtree_idw (default) or triangle_mesh, exact on the nodes
+  void setLazySource(int m) {lazysource = m;}
+  // uniform_grid node values: storage_double (default), storage_float
+  // or storage_int16, for maps built after this
+  void setFieldStorage(int s) {storage = s;}
+  // false keeps the file order of the nodes, without the field
+  // cache (stored in curve order); before read_fields()
+  void setSpatialOrder(bool s) {spatial = s;}
+  // no copy, 0 after releaseNodes()
+  std::shared_ptr<const field_nodes_t> nodes() {return store;}
+  // built at the first request for method and step (see Fields),
+  // then the same map for every Electrode and thread; aborts
+  // without field nodes, e.g. for a .fmap of an older version
+  std::shared_ptr<FieldMap> fieldMap(GeometryModel* gm, int method, double step);
+  // Electrodes asking for method and step get this map while the
+  // caller holds it, e.g. an instrumented or externally built one
+  void setFieldMap(int method, double step, std::shared_ptr<FieldMap> map);
+  // drop the nodes once the maps are built, maps keep what
+  // they use; a new map later reads the file again
+  void releaseNodes();
 };
 
 
@@ -45,27 +105,26 @@ class Fields {
  private:
   // pointer to geometry for asking
   GeometryModel* gm;
-  // container for field coordinates here
-  TKDTreeID* coordinates;
-  // storage container
-  double* allx;
-  double* ally;
-  double* alldx;
-  double* alldy;
+  // interpolation backend, see fieldmap.hh, shared
+  std::shared_ptr<FieldMap> map;
 
  protected:
-  void prepare_fields(ComsolFields* fem);
-  Point3 getFieldValue(Point3 p, bool& analytic);  
+  Point3 getFieldValue(const Point3& p, bool& analytic, double& safety);  
 
  public:
   // Constructor
-  Fields(ComsolFields* fem, GeometryModel* gm); // from file
+  // method: field_method_t, step: grid step [cm] (uniform or tiled grid), 0 from node spacing,
+  // or the relative tolerance for the quadtree, 0 for 1%
+  Fields(ComsolFields* fem, GeometryModel* gm, int method=0, double step=0.0); // from file
   
   // Default destructor
-  ~Fields();
+  ~Fields() {;}
 
   // Methods
   // return field values in [V/m]
-  Point3 getDriftField(Point3 p, bool& analytic);
+  Point3 getDriftField(const Point3& p, bool& analytic);
+  // safety [cm]: > 0 skips the region check, the caller knows it
+  // moved less than that since the last check; set anew by a check
+  Point3 getDriftField(const Point3& p, bool& analytic, double& safety);
 };
 #endif
@@ -2,13 +2,25 @@
 #define SNDRIFT_GEOMODEL_HH
 
 #include <vector>
+#include <memory>
 
 // ROOT includes
 #include "TGeoManager.h"
 #include "TGeoNode.h"
+#include "TGeoNavigator.h"
 
 // local
 
+// wire centre and radius in world coordinates [cm]
+struct wire_t {
+  double x;
+  double y;
+  double r;
+};
+
+// navigators handed out to threads, see geomodel.cpp
+struct geo_navigators;
+
 //***********************************
 // Charge signal class
 // to be used as an interface
@@ -17,13 +29,34 @@
 class GeometryModel {
  private:
   TGeoManager* geom;
+  std::shared_ptr<geo_navigators> navs; // per-thread TGeo navigation
+  bool lattice; // regions from the wire lattice, else TGeo
 
   // all wires
   std::vector<TGeoNode*> wires; // stores electrodes as TGeoNodes
+  std::vector<wire_t> wirelist; // same wires, plain numbers
+  double comsolbox[6]; // xmin, xmax, ymin, ymax, zmin, zmax [cm] of the drift region
+
+  // uniform 2D hash of the wires, cell -> wires touching it
+  double hashstep; // [cm]
+  int nhx; // cells in x
+  int nhy; // cells in y
+  std::vector<int> cellstart; // first entry of a cell in cellwires
+  std::vector<int> cellwires; // wire indices, cell by cell
+
+  // distance map, conservative per cell
+  double diststep; // [cm]
+  int ndx; // cells in x
+  int ndy; // cells in y
+  std::vector<double> safedist; // [cm] lower bound in the cell, < 0 outside
+  std::vector<int> nearest; // closest wire to the cell centre
   
 
  protected:  
   void fill_wires();
+  void make_hash();
+  void make_distance();
+  TGeoNavigator* navigator();
 
 
  public:
@@ -36,12 +69,29 @@ class GeometryModel {
   ~GeometryModel();
 
   // Methods
-  int whereami(double xv, double yv, double zv); // int coding of regions
+  int whereami(double xv, double yv, double zv); // int coding of regions, any thread
+  // same coding from the wire lattice, no TGeo, no lock;
+  // wire: index in wireList() when a wire is hit, else -1
+  int region(double xv, double yv, double zv, int& wire) const;
+  // distance [cm] the point is at least away from any wire surface
+  // and the box walls, negative outside the drift region; wire: closest
+  double distance(double xv, double yv, double zv, int& wire) const;
 
   // geometry get/set
 
+  // threads that may navigate at once besides the importing one,
+  // default all hardware threads; only grows, between transports
+  void setThreads(unsigned int n);
+  unsigned int getThreads();
+
+  // region(), distance() from the wires, or whereami() for every query
+  void setLattice(bool flag) {lattice = flag;}
+  bool useLattice() {return lattice;}
+
   // access geometry data
   std::vector<TGeoNode*> electrodes() {return wires;}
+  const std::vector<wire_t>& wireList() {return wirelist;}
+  void comsolBounds(double& xmin, double& xmax, double& ymin, double& ymax);
 
 };
 #endif
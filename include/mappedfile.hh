@@ -0,0 +1,68 @@
+#ifndef SNDRIFT_MAPPEDFILE_HH
+#define SNDRIFT_MAPPEDFILE_HH
+
+#include <string>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+
+
+// size [bytes] and modification time [s] of the source
+// a binary copy was made from, stamped into its header
+bool file_stamp(std::string fname, uint64_t& size, int64_t& mtime);
+// the directory of fname takes new files, see FileWriter
+bool file_writable(std::string fname);
+// bytes at offset inside a file of length, without overflow
+inline bool file_holds(uint64_t length, uint64_t offset, uint64_t bytes) {
+  return offset <= length && bytes <= length - offset;
+}
+
+
+//***********************************
+// Whole file mapped read-only, jobs
+// on one machine share it through
+// the page cache.
+//***********************************
+class MappedFile {
+ private:
+  void* base;
+  size_t length;
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+ public:
+  MappedFile() : base(0), length(0) {}
+  ~MappedFile() {unmap();}
+
+  // false, nothing mapped, if missing or shorter than minimum [bytes]
+  bool map(std::string fname, size_t minimum);
+  void unmap();
+
+  bool valid() {return base!=0;}
+  const char* data() {return (const char*)base;}
+  size_t size() {return length;}
+};
+
+
+//***********************************
+// New file written to a temporary
+// next to it and renamed by commit(),
+// readers never see half a file.
+//***********************************
+class FileWriter {
+ private:
+  std::string name;
+  std::string tmpname;
+  bool done;
+
+ public:
+  std::ofstream out;
+
+  FileWriter(std::string fname);
+  ~FileWriter(); // temporary removed without commit()
+
+  bool good() {return !!out;} // false e.g. for a read-only directory
+  bool commit(); // closed and renamed, false on any write error
+};
+#endif
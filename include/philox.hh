@@ -0,0 +1,71 @@
+#ifndef SNDRIFT_PHILOX_HH
+#define SNDRIFT_PHILOX_HH
+
+#include <cstdint>
+
+//***********************************
+// Counter-based random numbers,
+// Philox4x32-10 from Salmon et al.,
+// Proc. SC11 (2011) 16.
+// A generator is a (key, counter) pair,
+// no state is shared between streams.
+//***********************************
+class Philox {
+ private:
+  uint32_t key[2];
+  uint32_t ctr[4]; // ctr[0,1]: block number, ctr[2,3]: stream
+  uint32_t buf[4]; // current output block
+  int used;
+
+  static void round(uint32_t* c, const uint32_t* k) {
+    uint64_t p0 = (uint64_t)0xD2511F53u * c[0];
+    uint64_t p1 = (uint64_t)0xCD9E8D57u * c[2];
+    uint32_t c1 = c[1];
+    uint32_t c3 = c[3];
+    c[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k[0];
+    c[1] = (uint32_t)p1;
+    c[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k[1];
+    c[3] = (uint32_t)p0;
+  }
+
+  void next_block() {
+    block(ctr, key, buf);
+    if (++ctr[0]==0) ++ctr[1]; // 64 bit block counter
+    used = 0;
+  }
+
+ public:
+  // key: (k0, k1), stream: (s0, s1)
+  Philox(uint32_t k0, uint32_t k1, uint32_t s0, uint32_t s1) {
+    key[0] = k0;
+    key[1] = k1;
+    ctr[0] = 0;
+    ctr[1] = 0;
+    ctr[2] = s0;
+    ctr[3] = s1;
+    used = 4; // generate at first call
+  }
+  ~Philox() {;}
+
+  // bijection counter -> output, exposed for known-answer tests
+  static void block(const uint32_t* c, const uint32_t* k, uint32_t* out) {
+    uint32_t kk[2] = {k[0], k[1]};
+    for (int i=0;i<4;i++) out[i] = c[i];
+    for (int r=0;r<10;r++) {
+      round(out, kk);
+      kk[0] += 0x9E3779B9u;
+      kk[1] += 0xBB67AE85u;
+    }
+  }
+
+  uint32_t Integer() {
+    if (used==4) next_block();
+    return buf[used++];
+  }
+
+  // uniform in (0,1], like TRandom3::Rndm()
+  double Rndm() {
+    return (Integer() + 1.0) * 2.3283064365386963e-10; // 2^-32
+  }
+};
+#endif
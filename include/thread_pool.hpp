@@ -2,218 +2,255 @@
 #define THREAD_POOL_HPP
 
 #include <atomic>
-#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
 #include <functional>
-#include <future>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class thread_pool{
 public:
+	/**
+	 * Idle counters summed over all workers, to be inspected after a run.
+	 */
+	struct statistics{
+		unsigned long long tasks;   // tasks executed
+		unsigned long long parks;   // times a worker went to sleep
+		unsigned long long wakeups; // times a sleeping worker woke up
+		double idle_time;           // [s] spinning or parked, finished idle periods
+	};
+
 	thread_pool(unsigned int);
 	~thread_pool();
-	
+
+	template<typename Ret> class future;
+
 	/**
-	 * Pushes a new task (that returns a value and takes arguments) into 
-	 * the queue.
+	 * Pushes a new task into the queue. The task is run directly by one of
+	 * the long-lived pool workers, no thread is created per task.
 	 *
 	 * @param f the function to call when executing the task
 	 * @param args the arguments to pass to the function
 	 *
 	 * @return the future used to wait on the task and get the result
 	 */
-	template<typename Ret, typename... Args>
-	std::future<Ret> async(std::function<Ret(Args...)> f, Args... args){
-		typedef std::function<Ret(Args...)> F;
-		
-		std::promise<Ret> *p = new std::promise<Ret>;
-		
-		// Create a function to package as a task.
-		auto task_wrapper = [p](F&& f, Args... args){
-			p->set_value(std::move(f(args...)));
-		};
-		
-		// Create a function to package as a future for the user to wait on.
-		auto ret_wrapper = [p]() -> Ret{
-			auto temp = std::move(p->get_future().get());
-			
-			// Clean up resources
-			delete p;
-			
-			return std::move(temp);
-		};
-		
-		task_mutex.lock();
-		
-		// Package the task wrapper into a function to execute as a task.
-		auto task = std::async(std::launch::async, 
-			task_wrapper, 
-			std::move(f), 
-			args...);
-			
-		// Push the task onto the work queue.
-		tasks.emplace_back(std::move(task));
-		
-		task_mutex.unlock();
-		
-		// Package the return wrapper into a function for user to call to wait for the task to 
-		// complete and to get the result.
-		return std::async(std::launch::async, 
-				ret_wrapper);
-	}
-	
-	/**
-	 * Pushes a new task (that returns a value and doens't take arguments)
-	 * into the queue.
-	 *
-	 * @param f the function to call when executing the task
-	 *
-	 * @return the future used to wait on the task and get the result
-	 */
-	template<typename Ret>
-	std::future<Ret> async(std::function<Ret()> f){
-		typedef std::function<Ret()> F;
-		
-		std::promise<Ret> *p = new std::promise<Ret>;
-				
-		// Create a function to package as a task.
-		auto task_wrapper = [p](F&& f){
-			p->set_value(std::move(f()));
-		};
-				
-		// Create a function to package as a future for the user to wait on.
-		auto ret_wrapper = [p]() -> Ret{
-			auto temp = std::move(p->get_future().get());
-			
-			// Clean up resources
-			delete p;
-			
-			return std::move(temp);
-		};
-		
+	template<typename F, typename... Args>
+	future<typename std::result_of<F(Args...)>::type> async(F f, Args... args){
+		typedef typename std::result_of<F(Args...)>::type Ret;
+
+		// One allocation per task: the node holds the callable, its
+		// arguments and the result slot the future reads.
+		task_result<Ret>* t = new task_impl<F, Args...>(std::move(f), std::move(args)...);
+		future<Ret> result(t);
+
 		task_mutex.lock();
-				
-		// Package the task wrapper into a function to execute as a task.
-		auto task = std::async(std::launch::async, 
-			task_wrapper,
-			std::move(f));
-			
+
 		// Push the task onto the work queue.
-		tasks.emplace_back(std::move(task));
-		
+		push(t);
+		queued.fetch_add(1, std::memory_order_release);
+
+		// Only pay for a wakeup if a worker is actually parked.
+		if(sleeping > 0)
+			task_cv.notify_one();
+
 		task_mutex.unlock();
-		
-		// Package the return wrapper into a function for user to call to wait for the task to 
-		// complete and to get the result.
-		return std::async(std::launch::async, 
-				ret_wrapper);
+
+		return result;
 	}
-	
+
 	/**
-	 * Pushes a new task (that doesn't return a value and does take 
-	 * arguments) into the queue.
-	 *
-	 * @param f the function to call when executing the task
-	 * @param args the arguments to pass to the function
-	 *
-	 * @return the future used to wait on the task
+	 * @return the number of worker threads in the pool
 	 */
-	template<typename... Args>
-	std::future<void> async(std::function<void(Args...)> f, Args... args){
-		typedef std::function<void(Args...)> F;
-		
-		std::promise<void> *p = new std::promise<void>;
-				
-		// Create a function to package as a task.
-		auto task_wrapper = [p](F&& f, Args... args){
-			f(args...);
-			p->set_value();
-		};
-				
-		// Create a function to package as a future for the user to wait on.
-		auto ret_wrapper = [p](){
-			p->get_future().get();
-			
-			// Clean up resources
-			delete p;
-		};
-		
-		task_mutex.lock();		
-		
-		// Package the task wrapper into a function to execute as a task.
-		auto task = std::async(std::launch::async, 
-			task_wrapper,
-			std::move(f),
-			args...);
-			
-		// Push the task onto the work queue.
-		tasks.emplace_back(std::move(task));
-		
-		task_mutex.unlock();
-		
-		// Package the return wrapper into a function for user to call to wait for the task to 
-		// complete and to get the result.
-		return std::async(std::launch::async, 
-				ret_wrapper);
-	}
-	
+	unsigned int size() const {return num_threads;}
+
 	/**
-	 * Pushes a new task (that doesn't return a value and doesn't that
-	 * arguments) into the queue.
+	 * Sets how many times an idle worker yields while polling the queue
+	 * before it parks on the condition variable.
 	 *
-	 * @param f the function to call when executing the task
-	 *
-	 * @return the future used to wait on the task
+	 * @param n the number of spin rounds, 0 parks immediately
 	 */
-	std::future<void> async(std::function<void()> f){
-		typedef std::function<void()> F;
-		
-		std::promise<void> *p = new std::promise<void>;
-				
-		// Create a function to package as a task.
-		auto task_wrapper = [p](F&& f){
-			f();
-			p->set_value();
-		};
-				
-		// Create a function to package as a future for the user to wait on.
-		auto ret_wrapper = [p](){
-			p->get_future().get();
-			
-			// Clean up resources
-			delete p;
-		};
-		
-		task_mutex.lock();
-				
-		// Package the task wrapper into a function to execute as a task.
-		auto task = std::async(std::launch::async, 
-			task_wrapper,
-			std::move(f));
-			
-		// Push the task onto the work queue.
-		tasks.emplace_back(std::move(task));
-		
-		task_mutex.unlock();
-		
-		// Package the return wrapper into a function for user to call to wait for the task to 
-		// complete and to get the result.
-		return std::async(std::launch::async, 
-				ret_wrapper);
-	}
+	void set_spin(unsigned int n) {spin_count = n;}
+
+	statistics stats() const;
+	void reset_stats();
 
 protected:
 	void thread_func();
-	
+
 	void init_threads();
-	
+
 private:
+	/**
+	 * Type-erased queue entry, lets the queue hold tasks of any return
+	 * type. The queue and the future each hold a reference; the last one
+	 * to let go deletes the node.
+	 */
+	struct task_base{
+		task_base() : refs(2), done(false) {}
+		virtual ~task_base() {}
+		virtual void run() = 0;
+
+		void release(){
+			if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete this;
+		}
+		void finish(){
+			std::lock_guard<std::mutex> lock(done_mutex);
+			done = true;
+			done_cv.notify_all();
+		}
+		void wait(){
+			std::unique_lock<std::mutex> lock(done_mutex);
+			while(!done)
+				done_cv.wait(lock);
+		}
+
+		std::atomic<int> refs;
+		bool done;
+		std::mutex done_mutex;
+		std::condition_variable done_cv;
+		std::exception_ptr error; // thrown by the task, rethrown by get()
+	};
+
+	/**
+	 * Result slot, constructed in place when the task returns.
+	 */
+	template<typename Ret>
+	struct result_slot{
+		result_slot() : set(false) {}
+		~result_slot() {if(set) value()->~Ret();}
+		template<typename C, typename... A>
+		void call(C& c, A&&... a){
+			new(&store) Ret(c(std::forward<A>(a)...));
+			set = true;
+		}
+		Ret take() {return std::move(*value());}
+		Ret* value() {return reinterpret_cast<Ret*>(&store);}
+
+		typename std::aligned_storage<sizeof(Ret), std::alignment_of<Ret>::value>::type store;
+		bool set;
+	};
+
+	template<typename Ret>
+	struct task_result : task_base{
+		result_slot<Ret> result;
+	};
+
+	// argument unpacking, std::index_sequence is C++14
+	template<std::size_t... I> struct indices{};
+	template<std::size_t N, std::size_t... I>
+	struct make_indices : make_indices<N-1, N-1, I...>{};
+	template<std::size_t... I>
+	struct make_indices<0, I...>{typedef indices<I...> type;};
+
+	template<typename F, typename... Args>
+	struct task_impl : task_result<typename std::result_of<F(Args...)>::type>{
+		task_impl(F&& f, Args&&... a) : fn(std::move(f)), args(std::move(a)...) {}
+		void run(){
+			try{
+				invoke(typename make_indices<sizeof...(Args)>::type());
+			}
+			catch(...){
+				this->error = std::current_exception();
+			}
+			this->finish();
+		}
+		template<std::size_t... I>
+		void invoke(indices<I...>){
+			this->result.call(fn, std::get<I>(std::move(args))...);
+		}
+
+		F fn;
+		std::tuple<Args...> args;
+	};
+
+	void push(task_base* t);
+	task_base* pop();
+
 	bool join = false;
 	unsigned int num_threads;
-	
+	unsigned int sleeping = 0;
+	std::atomic<unsigned int> spin_count{1000};
+	std::atomic<unsigned int> queued{0};
+
 	std::mutex task_mutex;
-	std::deque<std::future<void>> tasks;
+	std::condition_variable task_cv;
+	std::vector<task_base*> ring; // queued tasks, power of two, grows by doubling
+	std::size_t head = 0;
+	std::size_t count = 0;
+
+	std::atomic<unsigned long long> ntasks{0};
+	std::atomic<unsigned long long> nparks{0};
+	std::atomic<unsigned long long> nwakeups{0};
+	std::atomic<long long> idle_ns{0};
 
 	std::list<std::thread> threads;
 };
 
+/**
+ * Handle to the result of a pool task, the part of std::future the
+ * callers use: get() waits, returns the value once or rethrows what the
+ * task threw.
+ */
+template<typename Ret>
+class thread_pool::future{
+public:
+	future() : node(0) {}
+	explicit future(task_result<Ret>* t) : node(t) {}
+	future(future&& other) : node(other.node) {other.node = 0;}
+	future& operator=(future&& other){
+		if(this != &other){
+			if(node)
+				node->release();
+			node = other.node;
+			other.node = 0;
+		}
+		return *this;
+	}
+	future(const future&) = delete;
+	future& operator=(const future&) = delete;
+	~future() {if(node) node->release();}
+
+	bool valid() const {return node != 0;}
+	void wait() {node->wait();}
+
+	Ret get(){
+		task_result<Ret>* t = node;
+		node = 0;
+		t->wait();
+		holder h(t);
+		if(t->error)
+			std::rethrow_exception(t->error);
+		return t->result.take();
+	}
+
+private:
+	struct holder{ // drops the reference also when get() rethrows
+		explicit holder(task_base* t) : t(t) {}
+		~holder() {t->release();}
+		task_base* t;
+	};
+
+	task_result<Ret>* node;
+};
+
+/**
+ * A task without return value still reports its end and exceptions.
+ */
+template<>
+struct thread_pool::result_slot<void>{
+	template<typename C, typename... A>
+	void call(C& c, A&&... a) {c(std::forward<A>(a)...);}
+	void take() {}
+};
+
 #endif // THREAD_POOL_HPP
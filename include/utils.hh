@@ -22,9 +22,9 @@ class Point3 {
   ~Point3() {;}
   
   void Set(double x, double y, double z);
-  double xc() {return xcoord;}
-  double yc() {return ycoord;}
-  double zc() {return zcoord;}
+  double xc() const {return xcoord;}
+  double yc() const {return ycoord;}
+  double zc() const {return zcoord;}
 };
 
 
@@ -74,9 +74,16 @@ struct charge_t {
   Point3 location;
   int charge;
   int chargeID; // distinguish e- (1) and gamma (0)
+  unsigned int stream; // random number stream, set by transport
+  unsigned int generation; // 0 for starters, 1 for avalanche secondaries
+  unsigned int lineage; // secondary path below the starter
 };
 
 
+// peak resident memory of this process [MB], 0 where unknown
+double peak_memory();
+
+
 typedef std::vector<Point3> path_t;
 
 #endif
@@ -0,0 +1,25 @@
+#ifndef SNDRIFT_VEC3_HH
+#define SNDRIFT_VEC3_HH
+
+//***********************************
+// Plain 3-vector for the transport
+// hot path, all inline, no ROOT.
+// ROOT types stay at the interfaces.
+//***********************************
+struct vec3_t {
+  double x;
+  double y;
+  double z;
+
+  void set(double xx, double yy, double zz) {x = xx; y = yy; z = zz;}
+  double dot(const vec3_t& v) const {return x*v.x + y*v.y + z*v.z;}
+  double mag2() const {return x*x + y*y + z*z;}
+
+  // this += s * v, the only update the kernel needs
+  void add(const vec3_t& v, double s) {
+    x += s * v.x;
+    y += s * v.y;
+    z += s * v.z;
+  }
+};
+#endif
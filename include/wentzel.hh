@@ -0,0 +1,35 @@
+#ifndef SNDRIFT_WENTZEL_HH
+#define SNDRIFT_WENTZEL_HH
+
+#include <vector>
+
+//***********************************
+// Helium elastic scattering angle,
+// Phys. of Plasmas, 19 (2012) 093511,
+// Wentzel approximation, sampled from
+// a precomputed inverse-CDF table.
+//***********************************
+class WentzelTable {
+ private:
+  int nenergy; // grid points in sqrt(energy)
+  int nuniform; // grid points in the uniform random number
+  double emax; // [eV] table range, analytic above
+  double escale; // cells per sqrt(eV)
+  std::vector<double> costable; // cos(theta), nenergy x nuniform
+
+ public:
+  // Constructor
+  WentzelTable(int ne=128, int nu=256, double emx=40.0);
+  
+  // Default destructor
+  ~WentzelTable() {;}
+
+  // Methods
+  static double xi(double energy); // screening parameter, energy [eV]
+  static double analytic(double energy, double r); // cos(theta) from r in [0,1]
+
+  // cos and sin of the scattering angle, theta in [0,pi]
+  void sample(double energy, double r, double& costh, double& sinth) const;
+  double maxError(int ntest=1000) const; // largest |cos| deviation on a test grid
+};
+#endif
@@ -1,18 +1,25 @@
 // us
 #include "ctransport.hh"
 #include "thread_pool.hpp"
+#include "cscache.hh"
 
 // standard includes
 #include <iostream>
 #include <string>
-#include <future>
+#include <exception>
 #include <functional>
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
 
 // ROOT includes
 #include "TMath.h"
-#include "TFile.h"
-#include "TNtupleD.h"
+
+// target masses: helium, ethanol, argon [GeV/c^2]
+static const double gasmass[3] = {4.0026 * 0.93149, 46.069 * 0.93149, 39.948 * 0.93149};
+static const double c2 = 2.99792458e8*2.99792458e8; // c^2 [m/s]^2
+static const double e_mass = 0.511e-3; // [GeV/c^2]
+static const double eoverm = 1.759e11; // Coulomb / kg
 
 
 //*******
@@ -22,14 +29,52 @@ Ctransport::Ctransport(std::string fname, int seed) {
   charges.clear();
   times.clear();
   places.clear();
+  inflight = 0;
+  nrun = 0;
+  ncollisions = 0;
+  nsteps = 0;
+  ntruncated = 0;
+  ngeochecks = 0;
+  ngeoskips = 0;
+  safetyskip = true; // exact, the distance map is conservative
+  kmax = 2.e-12; // constant for null coll. method, upper bound
+  adaptive = true; // energy dependent majorant
+  mixture[0] = 0.95; // [%] gas composition volume ratios
+  mixture[1] = 0.04;
+  mixture[2] = 0.01;
+  pool = 0; // created at first transport
+  ownpool = false;
+  setThreads(0); // default all hardware threads
   density = 0.1664; // [kg/m^3] fix NTP (295K) helium gas density
-  rnd = new TRandom3(seed);
+  rngseed = seed;
   readCS(fname); // fixed CS file name
 }
 
 
 Ctransport::~Ctransport() {
-  delete rnd;
+  if (ownpool) delete pool;
+}
+
+
+void Ctransport::setThreads(unsigned int n) {
+  if (n==0) n = std::thread::hardware_concurrency();
+  if (n==0) n = 1; // hardware not telling
+  if (ownpool) delete pool;
+  pool = 0; // new size at next transport
+  ownpool = false;
+  nthreads = n;
+}
+
+
+void Ctransport::setThreadPool(thread_pool* p) {
+  if (!p) { // back to an own pool of the current size
+    setThreads(nthreads);
+    return;
+  }
+  if (ownpool) delete pool;
+  pool = p;
+  ownpool = false;
+  nthreads = p->size();
 }
 
 
@@ -43,86 +88,73 @@ void Ctransport::ctransport(Electrode* electrode, std::list<charge_t> q) {
   // got all charges as initial input
   times.clear();
   places.clear();
+  order.clear();
   charges.clear(); // copy to data member
+  unsigned int stream = 0;
   for (charge_t cc : q) {
+    cc.stream = stream++; // random number stream by position
+    cc.generation = 0;
+    cc.lineage = 0;
     charges.push_front(cc); // insert from front
   }
   
   run(electrode);
-  return;
-}
-
-
-double Ctransport::pick_target(std::vector<double> weight, int& which) {
-  double target_mass;
-  double pick = rnd->Rndm();
-  if (pick <= weight[0]) { // Helium
-    target_mass = 4.0026 * 0.93149; // [GeV/c^2]
-    which = 0;
-  }
-  else if (pick > weight[0] && pick <= weight[0]+weight[1]) { // Ethanol
-    target_mass = 46.069 * 0.93149; // [GeV/c^2]
-    which = 1;
-  }
-  else { // Argon
-    target_mass = 39.948 * 0.93149; // [GeV/c^2]
-    which = 2;
+  nrun++; // fresh random numbers for the next call
+
+  // results in stream order, independent of thread scheduling
+  std::vector<unsigned int> idx(order.size());
+  for (unsigned int i=0;i<idx.size();i++) idx[i] = i;
+  std::sort(idx.begin(), idx.end(), [this](unsigned int a, unsigned int b) {return order[a] < order[b];});
+  std::vector<double> tsorted;
+  std::vector<Point3> psorted;
+  for (unsigned int i : idx) {
+    tsorted.push_back(times[i]);
+    psorted.push_back(places[i]);
   }
-  return target_mass;
+  times.swap(tsorted);
+  places.swap(psorted);
+  return;
 }
 
 
 bool Ctransport::taskfunction(Electrode* electrode, charge_t q) {
   // have a charge and info about all fields for each thread
 
-  //Init
-  TVector3 speed;
+  // own random number stream, keyed by run and charge,
+  // nothing shared with other threads
+  Philox rng(rngseed, nrun, q.stream, q.lineage);
+  unsigned int nsecondary = 0;
+
+  // electron state in plain doubles, SI units
+  vec3_t pos; // [m]
+  vec3_t vel; // [m/s]
+  vec3_t acc; // [m/s^2] from the field at the last real collision
   double energy;
-  double c2 = 2.99792458e8*2.99792458e8; // c^2 [m/s]^2
   double time_sum = 0.0;
-  double target_mass;
-  int inel_flag = 0;
-  int which = 0; // Helium
-  
-  TVector3 distance_sum, distance_step;
-
-  distance_step.SetXYZ(0.0,0.0,0.0);
-  speed.SetXYZ(0.0,0.0,0.0);
+  int process; // gas and process of a real collision, -1 for null
   
-  double e_mass = 0.511e-3; // [GeV/c^2]
-
-  std::vector<double> weight; // [%] gas composition volume ratios
-  weight.push_back(0.95);
-  weight.push_back(0.04);
-  weight.push_back(0.01);
-
-  target_mass = 4.0026 * 0.93149; // Helium default first target [GeV/c^2]
-  double mumass_eV = 1.0e9 * e_mass * target_mass / (e_mass + target_mass);
-
   double prob;
-  double localdensity = density * 6.023e26 / target_mass;// convert to number density [m^-3]
+  double localdensity = density * 6.023e26 / gasmass[0];// convert to number density [m^-3]
   // for E=2.12e8, gives E/N = 10Td = 1.e-16 Vcm^2
   
   double time_step, running_time;
-  double kmax = 2.e-12; // constant for null coll. method
   double kv;
-  double tau = 1/(localdensity * kmax);
+  double kmaj = kmax; // majorant for this flight
+  double tlimit = 1.e30; // flight time to the top of the majorant range
+  double eceil;
+  bool truncated;
   
   double init_energy;
   double speed_start, tangle;
 
-  // speed vector init
-  speed.SetXYZ(-1.0,0.0,0.0);
+  // speed vector init, along -x turned by theta
   init_energy = 1.e-9 * 0.025;// thermal start energy [GeV] 
   speed_start = TMath::Sqrt(2.0*init_energy / e_mass * c2);
-  speed.SetMag(speed_start);
-  tangle = TMath::Pi()*rnd->Rndm();// isotropic
-  speed.SetTheta(tangle);
+  tangle = TMath::Pi()*rng.Rndm();// isotropic
+  vel.set(-speed_start*TMath::Sin(tangle), 0.0, speed_start*TMath::Cos(tangle));
   
   time_sum = running_time = 0.0;
 
-  double x, y, z;
-  double xe, ye, ze;
   int elcharge;
   Point3 exyz; // Drift field
   Point3 point;
@@ -132,13 +164,21 @@ bool Ctransport::taskfunction(Electrode* electrode, charge_t q) {
   point = q.location; // start location, Point3 object; [cm] from ROOT
   previous = point;
 
-  // starting TVector3 from point
-  distance_sum.SetXYZ(point.xc()*0.01,point.yc()*0.01,point.zc()*0.01); // [cm]->[m]
+  // starting position from point
+  pos.set(point.xc()*0.01,point.yc()*0.01,point.zc()*0.01); // [cm]->[m]
 
   elcharge = q.charge; // -1: e-
   charge_t cc;
 
-  exyz = electrode->getFieldValue(analytic,point); // [V/m]
+  double safety = 0.0; // [cm] free to move without a region check
+  exyz = electrode->getFieldValue(analytic,point,safety); // [V/m]
+  acceleration(acc, elcharge, exyz);
+
+  unsigned long long ncoll = 0; // real collisions of this charge
+  unsigned long long nflight = 0; // real and null collisions
+  unsigned long long ntrunc = 0; // flights stopped at the majorant range
+  unsigned long long nchecks = 1; // region checks
+  unsigned long long nskips = 0; // region checks not needed
 
   // debug
   //  int nsteps = 0;
@@ -146,79 +186,115 @@ bool Ctransport::taskfunction(Electrode* electrode, charge_t q) {
   // transport loop
   while (!analytic) { 
 	
+    // majorant for the energies this flight may reach
+    if (adaptive) {
+      eceil = 1.5*lab_energy(vel) + 0.5; // [eV] headroom
+      kmaj = majorant_rate(eceil);
+      tlimit = flight_limit(vel, acc, eceil);
+    }
+
     // prepare and update
-    time_step = time_update(tau);
+    time_step = time_update(1.0/(localdensity * kmaj), rng);
+    truncated = (time_step > tlimit);
+    if (truncated) time_step = tlimit; // stop at the top of the range
     running_time += time_step;
     // keep track of total time
     time_sum += time_step;
 
     // vector addition stepwise turns velocity vector
-    speed += speed_update(elcharge,exyz,time_step);
-    
-    // CMS system energy
-    energy = 0.5*mumass_eV*speed.Mag2()/c2; // non-rel. energy in [eV]
-    // artificially raise the cross section 
-    kv = speed.Mag() * cross_section(energy, which, inel_flag);
-
-    if (inel_flag>0) { // was ionization
-      speed.SetXYZ(0.0,0.0,0.0); // inelastic takes energy off e-
-      kv = 0.0;
-      cc.location = point; // last known collision location
-      cc.chargeID = 1; // was an electron
-      cc.charge = -1; //
-      book_charge(cc); // store in object container
+    vel.add(acc, time_step);
+
+    if (truncated) {
+      // free flights are memoryless, restarting from here
+      // with the majorant of the new energy range is exact
+      ntrunc++;
+      continue;
     }
+    nflight++;
+    
+    // electron energy for the collision tables
+    energy = lab_energy(vel); // non-rel. lab energy in [eV]
+
+    // random number collision decision, one draw picks
+    // null or real collision, target gas and process
+    prob = rng.Rndm() * kmaj;
+    process = collision_process(energy, TMath::Sqrt(vel.mag2()), prob, kv);
     
-    if (kv>=kmax) {
+    if (kv>kmaj) {
       std::cout << "kmax too small" << std::endl;
       break;
     }
-    
-    // random number collision decision
-    prob = rnd->Rndm();
 	    
     // collision decision
-    if (prob <= (kv/kmax)) {
+    if (process>=0) {
+      ncoll++;
       //      nsteps += 1; // collision occurred
       //      if (!(nsteps % 100000)) std::cout << "collision " << nsteps << " : x,y coordinates " << point.xc() << " " << point.yc() << std::endl;
       //      if (nsteps>=5000) analytic = true; // stop after n steps
       // book position of collision
-      distance_step = d_update(speed,running_time);
-      distance_sum += distance_step; // in [m]
-      point.Set(distance_sum.X()*100.0,distance_sum.Y()*100.0,distance_sum.Z()*100.0); // [cm]
-
-      // new speed from elastic collision kinematics
-      speed = kin_factor2(speed, target_mass);
+      pos.add(vel, running_time); // in [m], acceleration done in vel
+      point.Set(pos.x*100.0,pos.y*100.0,pos.z*100.0); // [cm]
+      // step length bounds the displacement, safety shrinks by it
+      if (safetyskip)
+	safety -= 100.0 * TMath::Sqrt(vel.mag2()) * running_time; // [cm]
+      else
+	safety = 0.0;
+      if (safety > 0.0) nskips++;
+      else nchecks++;
+
+      if (process % 2) { // was ionization
+	vel.set(0.0,0.0,0.0); // inelastic takes energy off e-
+	// avalanche limit - hard cut on number of charges,
+	// fixed per starter to keep runs reproducible
+	if (q.generation==0 && nsecondary<10) {
+	  cc.location = point; // collision location
+	  cc.chargeID = 1; // was an electron
+	  cc.charge = -1; //
+	  cc.stream = q.stream; // stream derived from the parent
+	  cc.generation = q.generation + 1;
+	  cc.lineage = q.lineage * 11 + (++nsecondary); // unique below 10 per parent
+	  book_charge(cc); // store in object container
+	}
+      }
+      else // new speed from elastic collision kinematics
+	kin_factor2(vel, gasmass[process / 2], rng);
       
       // check geometry and fields
-      exyz = electrode->getFieldValue(analytic,point);
+      exyz = electrode->getFieldValue(analytic,point,safety);
+      acceleration(acc, elcharge, exyz);
       // std::cout << "in transport: field values " << exyz.xc() << " " << exyz.yc() << std::endl;
       // std::cout << "in transport: x,y coordinates " << point.xc() << " " << point.yc() << std::endl;
       // std::cout << "collision at energy " << energy << std::endl;
-      // std::cout << "speed X: " << speed.X() << " Y: " << speed.Y() << std::endl;
+      // std::cout << "speed X: " << vel.x << " Y: " << vel.y << std::endl;
       // std::cout << "time between coll " << running_time << std::endl;
 
       if (analytic) {
-	book_time(time_sum); // e- stopping, record time
-	book_place(previous); // stop location
+	book_stop(q, time_sum, previous); // e- stopping, record time and stop location
 	//	std::cout << "stop collision " << nsteps << " : current point " << point.xc() << " " << point.yc() << " " << point.zc() << std::endl;
       }
       // reset system, continue
       running_time = 0.0;
       previous = point;
-      target_mass = pick_target(weight, which);
-      mumass_eV = 1.0e9 * e_mass * target_mass / (e_mass + target_mass); // kinematics only
     }
     if (time_sum>=3.0e-5) { // 30 mus, particle got stuck, roughly 10^7 collisions
-      book_time(time_sum); // e- stopping, record time
-      book_place(previous); // stop location
+      book_stop(q, time_sum, previous); // e- stopping, record time and stop location
       std::cout << "STUCK: time = " << time_sum << std::endl;
       std::cout << "STUCK: place= " << point.xc() << " " << point.yc() << std::endl;
+      ncollisions += ncoll;
+      nsteps += nflight;
+      ntruncated += ntrunc;
+      ngeochecks += nchecks;
+      ngeoskips += nskips;
       return false;
     }
 
   }
   // one charge done
+  ncollisions += ncoll;
+  nsteps += nflight;
+  ntruncated += ntrunc;
+  ngeochecks += nchecks;
+  ngeoskips += nskips;
   return false;
 }
 
@@ -229,254 +305,334 @@ bool Ctransport::run(Electrode* electrode) {
   if (!electrode->isactive()) // not to repeat init
     electrode->initfields(); // ready to transport
 
-  unsigned int nthreads = std::thread::hardware_concurrency();
-  if (nthreads>4) nthreads = 4; // limit max CPU number
-  std::vector<std::future<bool> > results; 
-  thread_pool* pool = new thread_pool(nthreads); // task pool
+  if (!pool) { // task pool, kept for later calls
+    pool = new thread_pool(nthreads);
+    ownpool = true;
+  }
+  electrode->setThreads(pool->size()); // navigation slots for the workers
+  std::vector<thread_pool::future<bool> > results; 
+
+  inflight = 0;
+  // one draining task per thread, no barrier between charges
+  for (unsigned int n=0;n<pool->size();n++)
+    results.push_back(pool->async(std::function<bool(Electrode*)>(std::bind(&Ctransport::drain, this, std::placeholders::_1)), electrode)); // tasks
+
+  // wait for the basket to run dry
+  std::exception_ptr failure;
+  for (thread_pool::future<bool>& status : results){ 
+    try {
+      if (status.get())
+	flag = true;
+    }
+    catch (...) { // keep waiting, no worker may still be in drain()
+      if (!failure) failure = std::current_exception();
+    }
+  }
+  if (failure)
+    std::rethrow_exception(failure);
 
-  charge_t q;
-  int counter = 0;
+  // charge loop finished
+  return flag;
+}
 
-  while (!charges.empty()) { // stop when refilling stopped
-    //    std::cout << "from threads, charge basket size = " << charges.size() << std::endl;
 
-    // empty charges and store tasks in blocks of nthreads
-    for (int n=0;n<nthreads && !charges.empty();n++) { // drain charges basket
-      q = charges.front(); // get front element of std::list
-      results.push_back(pool->async(std::function<bool(Electrode*, charge_t)>(std::bind(&Ctransport::taskfunction, this, std::placeholders::_1, std::placeholders::_2)), electrode, q)); // tasks
+bool Ctransport::drain(Electrode* electrode) {
+  // pull charges until the basket is empty and no charge
+  // in flight can book secondaries anymore
+  bool flag = false;
+  charge_t q;
 
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lck (qmtx);
+      qcv.wait(lck, [this]{return !charges.empty() || inflight==0;});
+      if (charges.empty()) // nothing left, nothing in flight
+	return flag;
+      q = charges.front(); // get front element of std::list
       charges.pop_front(); // remove first charge from list
-      counter++; // counts tasks/electrons launched
+      inflight++;
     }
 
-    // drain task pool
-    for (std::future<bool>& status : results){ 
-      if (status.get()) // wait for completion before the next round
+    try {
+      if (taskfunction(electrode, q))
 	flag = true;
-      else
-	continue;
     }
-    // all tasks from pool finished - clear it. Next batch of charges in pool.
-    results.clear();
-  }
+    catch (...) { // drop the call, release the other workers
+      std::lock_guard<std::mutex> lck (qmtx);
+      charges.clear();
+      inflight--;
+      qcv.notify_all();
+      throw; // to run() through the future
+    }
 
-  //  std::cout << "from threads, total task counter = " << counter << std::endl;
-  // charge loop finished
-  delete pool;
-  return flag;
+    {
+      std::lock_guard<std::mutex> lck (qmtx);
+      inflight--;
+      if (inflight==0 && charges.empty())
+	qcv.notify_all(); // release idle workers, all done
+    }
+  }
 }
 
 
 void Ctransport::book_charge(charge_t q) {
-  std::lock_guard<std::mutex> lck (mtx); // protect thread access
-  // avalanche limit - hard cut on number of charges
-  if (charges.size() > 10) return;
+  std::lock_guard<std::mutex> lck (qmtx); // protect thread access
   charges.push_back(q); // total charge list to be filled/drained in threads
+  qcv.notify_one(); // wake an idle worker
   // feedback for big avalanches
   //  if (!(charges.size() % 10000)) std::cout << "charges booked " << charges.size() << std::endl;
   return;
 }
 
 
-void Ctransport::book_time(double tt) {
+void Ctransport::book_stop(charge_t& q, double tt, Point3 loc) {
   std::lock_guard<std::mutex> lck (mtx); // protect thread access
   times.push_back(tt); // time sum recorded
-  return;
-}
-
-
-void Ctransport::book_place(Point3 loc) {
-  std::lock_guard<std::mutex> lck (mtx); // protect thread access
-  places.push_back(loc); // time sum recorded
+  places.push_back(loc); // stop location recorded
+  order.push_back(((unsigned long long)q.stream << 32) | q.lineage); // sort key
   return;
 }
 
 
 int Ctransport::findBin(double en) {
-  std::lock_guard<std::mutex> lck (mtx); // protect thread access
+  // read-only tables, no lock needed
   // caution on energy
   if (en<0.0) en = 0.0;
   if (en>=40.0) return (int)energybins.size()-1; // final entry
 
-  std::vector<double>::iterator low;
-  low = std::lower_bound(energybins.begin(), energybins.end(), en); // find index with lower bound
-  int bin = (low - energybins.begin());
+  // same answer as std::lower_bound: grid cell gives the bin
+  // for its lower edge, at most a step or two further up
+  int bin = bingrid[(int)(en * gridscale)];
+  int nbins = (int)energybins.size();
+  while (bin<nbins && energybins[bin]<en) bin++;
   return bin;
 }
 
 
-double Ctransport::time_update(double tau)
+void Ctransport::makeBinGrid() {
+  // uniform grid on [0,40) eV, cells no wider than the
+  // narrowest MagBoltz bin unless that gets too large
+  double minwidth = 40.0;
+  for (unsigned int i=1;i<energybins.size();i++) {
+    double w = energybins[i] - energybins[i-1];
+    if (w>0.0 && w<minwidth) minwidth = w;
+  }
+  int ncells = (int)(40.0 / minwidth) + 1;
+  if (ncells > 65536) ncells = 65536; // few steps per lookup then
+
+  gridscale = ncells / 40.0; // cells per eV
+  bingrid.clear();
+  for (int c=0;c<=ncells;c++) { // one spare cell for rounding at 40 eV
+    std::vector<double>::iterator low;
+    low = std::lower_bound(energybins.begin(), energybins.end(), c / gridscale);
+    bingrid.push_back(low - energybins.begin());
+  }
+}
+
+
+double Ctransport::majorant_rate(double elab)
 {
-    return -tau*TMath::Log(rnd->Rndm());
+  // majorant for all energies up to elab [eV]
+  int cell = (int)(elab * majscale);
+  if (cell >= (int)majorant.size()) return kmax; // beyond the tables
+  return majorant[cell];
 }
 
-TVector3 Ctransport::speed_update(int charge, Point3 dfield, double time)
+
+double Ctransport::flight_limit(const vec3_t& v0, const vec3_t& acc, double eceil)
 {
-  TVector3 Efield(charge*dfield.xc(), charge*dfield.yc(), charge*dfield.zc()); // in [V/m]
-  double eoverm = 1.759e11; // Coulomb / kg
-  TVector3 v = eoverm * Efield * time;
-  return v;
+  // time until the lab energy reaches eceil [eV] in a constant field
+  double a2 = acc.mag2(); // [m/s^2]^2
+  if (a2<=0.0) return 1.e30; // no field, no energy gain
+
+  double vc2 = 2.0*eceil*c2/(1.0e9*e_mass); // speed^2 at eceil
+  double va = v0.dot(acc);
+  double disc = va*va - a2*(v0.mag2() - vc2); // positive, v0 below ceiling
+  return (-va + TMath::Sqrt(disc)) / a2;
 }
 
-TVector3 Ctransport::d_update(TVector3 v0, double time)
+
+void Ctransport::makeMajorants()
 {
-    TVector3 dstep = v0*time; // acceleration done already in speed_update
-    return dstep;
+  // Collision rate k = v sigma(E) of the mixture bounded from above,
+  // per cell of electron lab energy on [0,40] eV. Each cell holds the
+  // maximum for all energies up to its upper edge, hence the table
+  // rises monotonically. Above 40 eV the constant kmax holds.
+  double c = 2.99792458e8; // [m/s]
+  double mass_eV = 1.0e9 * e_mass;
+
+  int ncells = 800; // 50 meV cells
+  majscale = ncells / 40.0; // cells per eV
+  majorant.assign(ncells, 0.0);
+
+  // sigma is constant on (E_i-1, E_i] as picked by findBin
+  int nbins = (int)energybins.size();
+  for (int i=0;i<nbins;i++) {
+    double elow = (i>0) ? energybins[i-1] : 0.0;
+    double rate = c * TMath::Sqrt(2.0*energybins[i]/mass_eV) * cstable[i*nprocess + nprocess-1];
+    int cell = (int)(elow * majscale);
+    if (cell < ncells && rate > majorant[cell]) majorant[cell] = rate;
+  }
+  // past the last bin the final cross section stays, speed grows
+  double sigmalast = cstable[(nbins-1)*nprocess + nprocess-1];
+  for (int cell=0;cell<ncells;cell++) {
+    double ehigh = (cell+1) / majscale; // lab energy [eV]
+    if (ehigh <= energybins[nbins-1]) continue;
+    double rate = c * TMath::Sqrt(2.0*ehigh/mass_eV) * sigmalast;
+    if (rate > majorant[cell]) majorant[cell] = rate;
+  }
+  for (int cell=1;cell<ncells;cell++) // running maximum
+    if (majorant[cell] < majorant[cell-1]) majorant[cell] = majorant[cell-1];
+  for (int cell=0;cell<ncells;cell++) // keep free flights finite
+    if (majorant[cell] < 1.e-6*kmax) majorant[cell] = 1.e-6*kmax;
 }
 
-TVector3 Ctransport::kin_factor2(TVector3 v0, double target_mass)
+
+double Ctransport::time_update(double tau, Philox& rng)
 {
-  double azimuth;
-  TVector3 vel = v0;
-  //    double theta0 = v0.Theta();
-  double phi0 = v0.Phi();
-  double energy, transfer;
-  double c2 = 2.99792458e8*2.99792458e8; // c^2 [m/s]^2
-  double e_mass = 0.511e-3; // [GeV/c^2]
-  double reduced_mass = (4.0*target_mass*e_mass)/((target_mass + e_mass)*(target_mass + e_mass));
-  double mumass_eV = 1.0e9 * e_mass * target_mass / (e_mass + target_mass); // [eV]
-  
-  energy = 0.5 * mumass_eV * v0.Mag2() / c2; // non-rel. energy in [eV]
-  if (target_mass < 5.0)
-    azimuth = angle_function2(energy); // Helium
-  else
-    azimuth = TMath::Pi() * rnd->Rndm(); // isotropic for rare other targets
-  // TVector3 has theta defined relative to +z axis
-  double theta = TMath::Pi()/2.0;// in plane theta
-  
-  vel.SetTheta(theta);
-  vel.SetPhi(azimuth+phi0); // relative to previous
-  return vel;
+    return -tau*TMath::Log(rng.Rndm());
+}
+
+void Ctransport::acceleration(vec3_t& acc, int charge, const Point3& dfield)
+{
+  // field in [V/m] to acceleration [m/s^2], constant between collisions
+  acc.set(charge*eoverm*dfield.xc(), charge*eoverm*dfield.yc(), charge*eoverm*dfield.zc());
+}
+
+double Ctransport::lab_energy(const vec3_t& v)
+{
+  return 0.5*1.0e9*e_mass*v.mag2()/c2; // non-rel. energy in [eV]
 }
 
-double Ctransport::angle_function2(double energy)
+void Ctransport::kin_factor2(vec3_t& v0, double target_mass, Philox& rng)
 {
+  double costh, sinth;
+  double mumass_eV = 1.0e9 * e_mass * target_mass / (e_mass + target_mass); // [eV]
+  double energy = 0.5 * mumass_eV * v0.mag2() / c2; // non-rel. energy in [eV]
+
   // needs elastic scattering angular distribution in x,y plane
-  // for Helium: Phys. of Plasmas, 19 (2012) 093511; Wentzel approx.
-  // with energy in [eV]
-  const double p1 = 2.45;
-  const double p2 = 2.82;
-  const double p3 = 11.98;
-  const double p4 = 5.11;
-  const double p5 = 64.01;
-  double r = rnd->Rndm();
-  double sqre = TMath::Sqrt(energy);
-  double xi = 1.0 + (p1 * sqre - p2*p2 - p3) / ((sqre - p2)*(sqre - p2) + p3) - p1*sqre / ((sqre - p4)*(sqre - p4) + p5);
-  double nom = 2*r * (1.0 - xi);
-  double denom = 1.0 + xi * (1.0 - 2*r);
-  return TMath::ACos(1.0 - nom / denom);
+  if (target_mass < 5.0)
+    wentzel.sample(energy, rng.Rndm(), costh, sinth); // Helium, tabulated
+  else {
+    double azimuth = TMath::Pi() * rng.Rndm(); // isotropic for rare other targets
+    costh = TMath::Cos(azimuth);
+    sinth = TMath::Sin(azimuth);
+  }
+
+  // in plane rotation by the scattering angle relative to the
+  // previous direction, keeping the speed
+  double vmag = TMath::Sqrt(v0.mag2());
+  double vxy = TMath::Sqrt(v0.x*v0.x + v0.y*v0.y);
+  double cphi = 1.0; // phi0 = 0 for no in-plane motion
+  double sphi = 0.0;
+  if (vxy > 0.0) {
+    cphi = v0.x / vxy;
+    sphi = v0.y / vxy;
+  }
+  v0.set(vmag * (cphi*costh - sphi*sinth), vmag * (sphi*costh + cphi*sinth), 0.0);
 }
 
 
 // read and prepare the cross sections from file
 void Ctransport::readCS(std::string csname) {
-  TFile ff(csname.data(),"read");
-  TNtupleD* nt = (TNtupleD*)ff.Get("cs");
-  int nentries = nt->Draw("csel:csinel:energy","weight>0.5","goff"); // for helium cs histogram
-
-  // set up x-axis for histograms
-  double* en = nt->GetV3();
-
-  // set up helium cs
-  double* csel = nt->GetV1();
-  double* csinel = nt->GetV2();
-  for (int i=0;i<nentries;i++) {
-    energybins.push_back(en[i]); // sorted already
-    HeCSel.push_back(csel[i] * 1.e-4); // convert to SI [m^2]
-    HeCSinel.push_back(csinel[i] * 1.e-4);
+  // a .csbin file directly, else the ROOT file through
+  // its binary copy next to it, made at the first start
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool standalone = (csname.size()>6 && csname.compare(csname.size()-6, 6, ".csbin")==0);
+  std::string cname = standalone ? csname : csname + ".csbin";
+  std::string from = cname;
+  CSCache* cache = new CSCache(cname, standalone ? "" : csname);
+  cs_table_t cs;
+  if (cache->valid()) {
+    int n = cache->bins();
+    cs.energy.assign(cache->energy(), cache->energy()+n);
+    for (int g=0;g<3;g++) {
+      cs.el[g].assign(cache->elastic(g), cache->elastic(g)+n);
+      cs.inel[g].assign(cache->inelastic(g), cache->inelastic(g)+n);
+    }
   }
-  std::cout << "In CTransport: helium cross sections from file: " << nentries << std::endl;
-
-  // set up ethanol cs
-  nentries = nt->Draw("csel:csinel","weight>0.02 && weight<0.5","goff"); // for ethanol cs histogram
-  csel = nt->GetV1();
-  csinel = nt->GetV2();
-  for (int i=0;i<nentries;i++) {
-    EthCSel.push_back(csel[i] * 1.e-4);
-    EthCSinel.push_back(csinel[i] * 1.e-4);
+  else if (standalone) { // nothing to transport with
+    std::cout << "Error: no valid cross section table in " << csname << std::endl;
+    std::abort();
   }
-  std::cout << "In CTransport: ethanol cross sections from file: " << nentries << std::endl;
-
-  // set up argon cs
-  nentries = nt->Draw("csel:csinel","weight<0.02","goff"); // for argon cs histogram
-  csel = nt->GetV1();
-  csinel = nt->GetV2();
-  for (int i=0;i<nentries;i++) {
-    ArCSel.push_back(csel[i] * 1.e-4);
-    ArCSinel.push_back(csinel[i] * 1.e-4);
+  else {
+    from = csname;
+    if (!read_cs_root(csname, cs) || cs.energy.empty()) { // no table, and none to cache
+      std::cout << "Error: no cross sections read from " << csname << std::endl;
+      std::abort();
+    }
+    if (!CSCache::write(cname, csname, cs))
+      std::cout << "In CTransport: cannot write cross section cache " << cname << std::endl;
+  }
+  delete cache; // all copied
+
+  energybins = cs.energy;
+  HeCSel = cs.el[0];
+  HeCSinel = cs.inel[0];
+  EthCSel = cs.el[1];
+  EthCSinel = cs.inel[1];
+  ArCSel = cs.el[2];
+  ArCSinel = cs.inel[2];
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "In CTransport: helium, ethanol, argon cross sections from " << from << ": "
+	    << HeCSel.size() << ", " << EthCSel.size() << ", " << ArCSel.size()
+	    << " in [s] " << elapsed << std::endl;
+
+  makeBinGrid(); // lookup for findBin
+  makeTables(); // combined collision tables
+  makeMajorants(); // null collision rates
+}
+
+
+// combined collision tables for the current gas mixture
+void Ctransport::makeTables() {
+  // Per energy bin, cumulative mixture weighted cross sections [m^2]
+  // over (gas x process) in one interleaved array: helium elastic,
+  // helium ionization, ethanol elastic, ... argon ionization.
+  std::vector<double>* csel[3] = {&HeCSel, &EthCSel, &ArCSel};
+  std::vector<double>* csinel[3] = {&HeCSinel, &EthCSinel, &ArCSinel};
+
+  cstable.clear();
+  for (unsigned int i=0;i<energybins.size();i++) {
+    double cumulative = 0.0;
+    for (int g=0;g<3;g++) {
+      cumulative += mixture[g] * csel[g]->at(i);
+      cstable.push_back(cumulative);
+      cumulative += mixture[g] * csinel[g]->at(i);
+      cstable.push_back(cumulative);
+    }
   }
-  ff.Close();
-  std::cout << "In CTransport: argon cross sections from file: " << nentries << std::endl;
 }
 
 
-// cross sections retrieve from MagBoltz output file.
-double Ctransport::cross_section(double energy, int which, int &inel_flag)
+void Ctransport::setMixture(double he, double eth, double ar) {
+  // volume fractions, normalised here; not during transport
+  double sum = he + eth + ar;
+  if (sum<=0.0) {
+    std::cout << "Error: gas mixture fractions must add up to more than zero" << std::endl;
+    return;
+  }
+  mixture[0] = he / sum;
+  mixture[1] = eth / sum;
+  mixture[2] = ar / sum;
+  makeTables();
+  makeMajorants();
+}
+
+
+// pick the collision process with one uniform number u in [0,kmax)
+int Ctransport::collision_process(double energy, double speed, double u, double& kv)
 {
-  // retrieve from MagBoltz output file.
-  double cs_el, cs_inel,ratio;
   int bin = findBin(energy);
-  
-  inel_flag = 0; // default case
-
   // shouldn't happen but does, it seems
   if (bin>=(int)energybins.size()) 
     bin = (int)energybins.size()-1; // final entry
-  if (energy >= 40.0) energy = 39.9; // max range of energybins from MagBoltz
- 
-  // debug
-  // if (energy>10.0) 
-  //   std::cout << "Inside cross section with en " << energy << " gas which " << which << " and energy bin " << bin << std::endl;
-
-  switch(which) {
-  case 0: { // Helium
-    cs_el = HeCSel.at(bin);
-    cs_inel = HeCSinel.at(bin);
-    if (cs_inel>0.0) { // decision elastic to ionization
-      ratio = cs_inel / (cs_el+cs_inel);
-      if (rnd->Rndm() < ratio) {
-	inel_flag = 1; // ionization electron
-	//	std::cout << "helium inelastic collision at energy " << energy << std::endl;
-	return 0.0; // stops further transport after inel
-      }
-      else
-	return cs_el;
-    }
-    else 
-      return cs_el;    
-  }
-  case 1: { // Ethanol
-    cs_el = EthCSel.at(bin);
-    cs_inel = EthCSinel.at(bin);
-    if (cs_inel>0.0) { // decision elastic to ionization
-      ratio = cs_inel / (cs_el+cs_inel);
-      if (rnd->Rndm() < ratio) {
-	inel_flag = 1; // ionization electron
-	//	std::cout << "ethanol inelastic collision at energy " << energy << std::endl;
-	return 0.0; // stops further transport after inel
-      }
-      else
-	return cs_el;
-    }
-    else
-      return cs_el;
-  }
-  case 2: { // Argon
-    cs_el = ArCSel.at(bin);
-    cs_inel = ArCSinel.at(bin);
-    if (cs_inel>0.0) { // decision elastic to ionization
-      ratio = cs_inel / (cs_el+cs_inel);
-      if (rnd->Rndm() < ratio) {
-	inel_flag = 1; // ionization electron
-	//	std::cout << "argon inelastic collision at energy " << energy << std::endl;
-	return 0.0; // stops further transport after inel
-      }
-      else
-	return cs_el;
-    }
-    else
-      return cs_el;
-  }
-  default: return 0.0; // not needed but stops further transport after inel
-  }
+
+  const double* cumulative = &cstable[bin * nprocess];
+  kv = speed * cumulative[nprocess-1]; // total collision rate
+  if (u > kv) return -1; // null collision
+
+  int process = 0;
+  while (u > speed * cumulative[process]) process++;
+  return process; // gas = process/2, ionization if odd
 }
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+// us
+#include "cscache.hh"
+
+// ROOT includes
+#include "TFile.h"
+#include "TNtupleD.h"
+
+
+// gas blocks by mixture weight as written by cs2root.py
+static int gas_index(double weight) {
+  if (weight>0.5) return 0; // helium
+  if (weight>0.02) return 1; // ethanol
+  return 2; // argon
+}
+
+
+bool read_cs_root(std::string fname, cs_table_t& cs) {
+  TFile ff(fname.data(),"read");
+  TNtupleD* nt = (TNtupleD*)ff.Get("cs");
+  if (!nt) return false;
+  double weight, energy, csel, csinel;
+  nt->SetBranchAddress("weight",&weight);
+  nt->SetBranchAddress("energy",&energy);
+  nt->SetBranchAddress("csel",&csel);
+  nt->SetBranchAddress("csinel",&csinel);
+
+  int nentries = nt->GetEntries();
+  for (int i=0;i<nentries;i++) {
+    nt->GetEntry(i);
+    int g = gas_index(weight);
+    if (g==0) cs.energy.push_back(energy); // sorted already
+    cs.el[g].push_back(csel * 1.e-4); // convert to SI [m^2]
+    cs.inel[g].push_back(csinel * 1.e-4);
+  }
+  ff.Close();
+  return true;
+}
+
+
+bool read_cs_magboltz(std::string fname, cs_table_t& cs) {
+  // same reading as cs2root.py: '#' lines end a gas block,
+  // single space separated columns 0, 2 and 4 in [eV], [cm^2]
+  std::ifstream in(fname.data());
+  if (!in) return false;
+  std::string line;
+  int block = 0;
+  bool numbers = false;
+  while (std::getline(in, line)) {
+    if (line.empty()) continue;
+    std::vector<std::string> row;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ' ')) row.push_back(field);
+    if (row[0]=="#") {
+      if (numbers) {
+	block++;
+	numbers = false;
+      }
+      continue;
+    }
+    if (block>2 || row.size()<5) return false; // not the expected layout
+    numbers = true;
+    if (block==0) cs.energy.push_back(std::atof(row[0].data()));
+    cs.el[block].push_back(std::atof(row[2].data()) * 1.e-4);
+    cs.inel[block].push_back(std::atof(row[4].data()) * 1.e-4);
+  }
+  return true;
+}
+
+
+CSCache::CSCache(std::string cname, std::string source) {
+  head = 0;
+  bool standalone = source.empty();
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  if (!standalone && !file_stamp(source, size, mtime)) return; // nothing to compare to
+  if (!file.map(cname, sizeof(header_t))) return; // no cache yet
+
+  const header_t* h = (const header_t*)file.data();
+  bool current = (std::strncmp(h->magic, "SNDCSEC", 8)==0 &&
+		  h->version == version && h->nbins > 0 &&
+		  (standalone || (h->source_size == size && h->source_mtime == mtime)));
+  for (int k=0;k<7 && current;k++) // energy and cross section arrays
+    current = file_holds(file.size(), h->offset[k], sizeof(double) * (uint64_t)h->nbins);
+  if (current)
+    head = h;
+  else
+    file.unmap();
+}
+
+
+bool CSCache::write(std::string cname, std::string source, const cs_table_t& cs) {
+  header_t h;
+  std::memset(&h, 0, sizeof(h));
+  std::strncpy(h.magic, "SNDCSEC", 8);
+  h.version = version;
+  h.nbins = cs.energy.size();
+  if (h.nbins==0) { // a stamped empty table would stay current
+    std::cout << "Error: no cross sections to write" << std::endl;
+    return false;
+  }
+  for (int g=0;g<3;g++)
+    if (cs.el[g].size()!=h.nbins || cs.inel[g].size()!=h.nbins) {
+      std::cout << "Error: cross section blocks differ in length" << std::endl;
+      return false;
+    }
+  if (!source.empty() && !file_stamp(source, h.source_size, h.source_mtime)) return false;
+  uint64_t block = h.nbins * sizeof(double);
+  for (int k=0;k<7;k++) h.offset[k] = sizeof(header_t) + k * block;
+
+  FileWriter w(cname);
+  if (!w.good()) return false; // e.g. read-only data directory
+  w.out.write((const char*)&h, sizeof(h));
+  w.out.write((const char*)cs.energy.data(), block);
+  for (int g=0;g<3;g++) w.out.write((const char*)cs.el[g].data(), block);
+  for (int g=0;g<3;g++) w.out.write((const char*)cs.inel[g].data(), block);
+  return w.commit();
+}
@@ -10,6 +10,8 @@ Electrode::Electrode(ComsolFields* fem, GeometryModel* g) {
   femfields = fem;
   active = false;
   field = 0;
+  method = 0; // KD-tree IDW
+  step = 0.0;
 }
 
 
@@ -21,12 +23,13 @@ Electrode::~Electrode() {
 
 void Electrode::initfields() {
   active = true;
-  field = new Fields(femfields, gm); // create from file + geometry info
+  field = new Fields(femfields, gm, method, step); // create from file + geometry info
 }
 
 
-Point3 Electrode::getFieldValue(bool& analytic, Point3 p) {
-  std::lock_guard<std::mutex> lck (mtx); // protect thread access
+Point3 Electrode::getFieldValue(bool& analytic, const Point3& p) {
+  // no lock, the field maps and the wire lattice
+  // are read-only once initfields ran
   Point3 triplet;
   
   triplet = field->getDriftField(p, analytic);
@@ -35,3 +38,6 @@ Point3 Electrode::getFieldValue(bool& analytic, Point3 p) {
 }
 
 
+Point3 Electrode::getFieldValue(bool& analytic, const Point3& p, double& safety) {
+  return field->getDriftField(p, analytic, safety);
+}
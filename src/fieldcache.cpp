@@ -0,0 +1,158 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <functional>
+
+// us
+#include "fieldcache.hh"
+#include "thread_pool.hpp"
+
+
+// nodes of one chunk of the text
+struct text_chunk_t {
+  std::vector<double> x, y, ex, ey;
+  bool ok;
+};
+
+
+static text_chunk_t parse_chunk(const char* from, const char* to) {
+  // whole lines only, from and to sit at line starts
+  text_chunk_t c;
+  c.ok = true;
+  const char* p = from;
+  while (p < to) {
+    const char* eol = p;
+    while (eol < to && *eol!='\n') eol++;
+    const char* q = p;
+    while (q < eol && (*q==' ' || *q=='\t' || *q=='\r')) q++;
+    if (q < eol && *q!='%') { // not empty, not a COMSOL comment
+      double v[4];
+      for (int k=0;k<4;k++) {
+	while (q < eol && (*q==',' || *q==' ' || *q=='\t' || *q==';')) q++;
+	char* end;
+	v[k] = std::strtod(q, &end);
+	if (end==q || end>eol) {
+	  c.ok = false; // not four numbers
+	  return c;
+	}
+	q = end;
+      }
+      c.x.push_back(v[0]*1.0e2); // [m]->[cm]
+      c.y.push_back(v[1]*1.0e2);
+      c.ex.push_back(v[2]);
+      c.ey.push_back(v[3]);
+    }
+    p = eol + 1;
+  }
+  return c;
+}
+
+
+bool read_comsol_text(std::string fname, int nthreads, int skip,
+		      std::vector<double>& x, std::vector<double>& y,
+		      std::vector<double>& ex, std::vector<double>& ey) {
+  std::ifstream in(fname.c_str(), std::ios::binary);
+  if (!in) return false;
+  in.seekg(0, std::ios::end);
+  std::vector<char> text((size_t)in.tellg() + 1, '\0'); // strtod stops at the end
+  in.seekg(0, std::ios::beg);
+  in.read(text.data(), text.size()-1);
+  const char* begin = text.data();
+  const char* end = begin + text.size()-1;
+  for (int i=0;i<skip && begin<end;i++) { // header lines
+    while (begin<end && *begin!='\n') begin++;
+    if (begin<end) begin++;
+  }
+
+  // chunks cut after a newline, parsed in order of the file
+  if (nthreads<1) nthreads = 1;
+  std::vector<const char*> cuts(1, begin);
+  for (int k=1;k<nthreads;k++) {
+    const char* c = begin + (end-begin) * k / nthreads;
+    if (c < cuts.back()) c = cuts.back();
+    while (c<end && c>begin && *(c-1)!='\n') c++;
+    cuts.push_back(c);
+  }
+  cuts.push_back(end);
+
+  thread_pool pool(nthreads);
+  std::vector<thread_pool::future<text_chunk_t> > parts;
+  for (int k=0;k<nthreads;k++)
+    parts.push_back(pool.async(std::function<text_chunk_t(const char*, const char*)>(parse_chunk), cuts[k], cuts[k+1]));
+  std::vector<text_chunk_t> chunks;
+  size_t total = 0;
+  for (thread_pool::future<text_chunk_t>& f : parts) {
+    chunks.push_back(f.get());
+    if (!chunks.back().ok) return false;
+    total += chunks.back().x.size();
+  }
+  x.clear();
+  y.clear();
+  ex.clear();
+  ey.clear();
+  x.reserve(total);
+  y.reserve(total);
+  ex.reserve(total);
+  ey.reserve(total);
+  for (text_chunk_t& c : chunks) {
+    x.insert(x.end(), c.x.begin(), c.x.end());
+    y.insert(y.end(), c.y.begin(), c.y.end());
+    ex.insert(ex.end(), c.ex.begin(), c.ex.end());
+    ey.insert(ey.end(), c.ey.begin(), c.ey.end());
+  }
+  return true;
+}
+
+
+FieldCache::FieldCache(std::string cname, std::string source) {
+  head = 0;
+  bool standalone = source.empty();
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  if (!standalone && !file_stamp(source, size, mtime)) return; // nothing to compare to
+  if (!file.map(cname, sizeof(header_t))) return; // no cache yet
+
+  const header_t* h = (const header_t*)file.data();
+  uint64_t length = file.size();
+  bool current = (std::strncmp(h->magic, "SNDFMAP", 8)==0 &&
+		  h->version == version &&
+		  (standalone || (h->source_size == size && h->source_mtime == mtime)) &&
+		  file_holds(length, h->offset[4], 6 * sizeof(int) * (uint64_t)h->ntriangles));
+  for (int k=0;k<4 && current;k++) // node arrays
+    current = file_holds(length, h->offset[k], sizeof(double) * (uint64_t)h->nnodes);
+  if (current)
+    head = h;
+  else
+    file.unmap();
+}
+
+
+bool FieldCache::write(std::string cname, std::string source,
+		       const std::vector<double>& x, const std::vector<double>& y,
+		       const std::vector<double>& ex, const std::vector<double>& ey,
+		       const std::vector<int>& tris, int start, const double* helpers) {
+  header_t h;
+  std::memset(&h, 0, sizeof(h));
+  std::strncpy(h.magic, "SNDFMAP", 8);
+  h.version = version;
+  if (!source.empty() && !file_stamp(source, h.source_size, h.source_mtime)) return false;
+  h.nnodes = x.size();
+  h.ntriangles = tris.size() / 6;
+  h.start = start;
+  for (int k=0;k<6;k++) h.helpers[k] = helpers[k];
+  uint64_t block = h.nnodes * sizeof(double);
+  for (int k=0;k<5;k++) h.offset[k] = sizeof(header_t) + k * block; // 8 byte aligned
+
+  FileWriter w(cname);
+  if (!w.good()) return false; // e.g. read-only data directory
+  w.out.write((const char*)&h, sizeof(h));
+  w.out.write((const char*)x.data(), block);
+  w.out.write((const char*)y.data(), block);
+  w.out.write((const char*)ex.data(), block);
+  w.out.write((const char*)ey.data(), block);
+  w.out.write((const char*)tris.data(), tris.size() * sizeof(int));
+  return w.commit();
+}
@@ -0,0 +1,1182 @@
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+
+// POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// us
+#include "fieldmap.hh"
+#include "fieldcache.hh"
+#include "mappedfile.hh"
+
+
+//***********
+// KD-tree IDW
+//***********
+KDTreeMap::KDTreeMap(ComsolFields* fem) {
+  build(fem->nodes());
+}
+
+
+KDTreeMap::KDTreeMap(std::shared_ptr<const field_nodes_t> store) {
+  build(store);
+}
+
+
+void KDTreeMap::build(std::shared_ptr<const field_nodes_t> store) {
+  nodes = store; // shared, not copied
+  nnodes = nodes->x.size();
+
+  coordinates = new TKDTreeID(nnodes,2,1);
+
+  // no transf needed, requests come as vectors;
+  // the tree only reads the coordinates
+  allx = nodes->x.data();
+  ally = nodes->y.data();
+  alldx = nodes->ex.data();
+  alldy = nodes->ey.data();
+  coordinates->SetData(0,const_cast<double*>(allx));
+  coordinates->SetData(1,const_cast<double*>(ally));
+  coordinates->Build();
+  // FindNearestNeighbors calls MakeBoundariesExact() at its first
+  // query unless boundaries exist; done here so concurrent queries
+  // only read the tree, and exact (node) boxes prune best
+  coordinates->MakeBoundariesExact();
+  // all done and in memory
+}
+
+
+KDTreeMap::~KDTreeMap() {
+  delete coordinates;
+}
+
+
+void KDTreeMap::field(double x, double y, double& ex, double& ey) {
+  // scratch on the stack, nothing shared between threads
+  double point[2];
+  double dist[8]; // check on nearest 8 neighbours in grid
+  int indx[8];
+
+  double dsum = 0.0;
+  point[0] = x;  // relative to origin x
+  point[1] = y;  // relative to origin y
+
+  coordinates->FindNearestNeighbors(point,8,indx,dist);
+  for (int j=0;j<8;j++)
+    dsum += dist[j];
+
+  double denom = 0.0;
+  for (int j=0;j<8;j++) denom += (1.0-dist[j]/dsum);
+
+  ex = 0.0;
+  ey = 0.0;
+  for (int j=0;j<8;j++) {
+    double w = (1.0-dist[j]/dsum)/denom;
+    ex += w * alldx[indx[j]];
+    ey += w * alldy[indx[j]];
+  }
+}
+
+
+size_t KDTreeMap::memory() {
+  // node arrays plus the tree index, about one int per node and level
+  return 4 * nnodes * sizeof(double) + 2 * nnodes * sizeof(int);
+}
+
+
+void KDTreeMap::bounds(double& xmin, double& xmax, double& ymin, double& ymax) {
+  node_bounds(nodes->x, nodes->y, xmin, xmax, ymin, ymax);
+}
+
+
+double KDTreeMap::spacing() {
+  return node_spacing(nodes->x, nodes->y);
+}
+
+
+//***********
+// Grid geometry
+//***********
+void node_bounds(const std::vector<double>& x, const std::vector<double>& y,
+		 double& xmin, double& xmax, double& ymin, double& ymax) {
+  xmin = xmax = x[0];
+  ymin = ymax = y[0];
+  for (unsigned int i=1;i<x.size();i++) {
+    if (x[i]<xmin) xmin = x[i];
+    if (x[i]>xmax) xmax = x[i];
+    if (y[i]<ymin) ymin = y[i];
+    if (y[i]>ymax) ymax = y[i];
+  }
+}
+
+
+double node_spacing(const std::vector<double>& x, const std::vector<double>& y) {
+  double xmin, xmax, ymin, ymax;
+  node_bounds(x, y, xmin, xmax, ymin, ymax);
+  return std::sqrt((xmax-xmin)*(ymax-ymin) / x.size()); // [cm]
+}
+
+
+void grid_geometry_t::set(double xmin, double xmax, double ymin, double ymax,
+			  double st, int c, double maxnodes) {
+  x0 = xmin;
+  y0 = ymin;
+  step = st;
+  nx = (int)std::ceil((xmax - xmin) / step) + 1;
+  ny = (int)std::ceil((ymax - ymin) / step) + 1;
+  while (maxnodes > 0.0 && (double)nx * ny > maxnodes) {
+    step *= 1.25;
+    nx = (int)std::ceil((xmax - xmin) / step) + 1;
+    ny = (int)std::ceil((ymax - ymin) / step) + 1;
+  }
+  inverse = 1.0 / step;
+  cells = c;
+  ntx = (c > 0) ? (nx - 2) / c + 1 : 0; // cells nx-1 in tiles of c
+  nty = (c > 0) ? (ny - 2) / c + 1 : 0;
+}
+
+
+//***********
+// Uniform grid
+//***********
+GridMap::GridMap(KDTreeMap* source, double st) {
+  double xmin, xmax, ymin, ymax;
+  source->bounds(xmin, xmax, ymin, ymax);
+  // keep memory sane for very fine steps, 16M nodes = 256 MB
+  grid.set(xmin, xmax, ymin, ymax, (st > 0.0) ? st : source->spacing(), 0, grid_max_nodes);
+
+  // resample the source at the grid nodes
+  int nx = grid.nx;
+  gex.resize(nx * grid.ny);
+  gey.resize(nx * grid.ny);
+  for (int j=0;j<grid.ny;j++)
+    for (int i=0;i<nx;i++)
+      source->field(grid.x0 + i*grid.step, grid.y0 + j*grid.step, gex[j*nx + i], gey[j*nx + i]);
+  std::cout << "in GridMap: " << nx << " x " << grid.ny << " nodes, step [cm] " << grid.step << std::endl;
+}
+
+
+void GridMap::field(double x, double y, double& ex, double& ey) {
+  int i, j;
+  double fx, fy;
+  grid.cell(x, y, i, j, fx, fy);
+
+  int nx = grid.nx;
+  int n = j*nx + i;
+  double w00 = (1.0-fx)*(1.0-fy);
+  double w10 = fx*(1.0-fy);
+  double w01 = (1.0-fx)*fy;
+  double w11 = fx*fy;
+  ex = w00*gex[n] + w10*gex[n+1] + w01*gex[n+nx] + w11*gex[n+nx+1];
+  ey = w00*gey[n] + w10*gey[n+1] + w01*gey[n+nx] + w11*gey[n+nx+1];
+}
+
+
+size_t GridMap::memory() {
+  return (gex.size() + gey.size()) * sizeof(double);
+}
+
+
+//***********
+// Triangle mesh
+//***********
+MeshMap::MeshMap(ComsolFields* fem) {
+  share(fem->nodes());
+  FieldCache* fc = fem->cache();
+  if (fc && fc->triangles()>0 && fc->nodes()==nnodes)
+    adopt(fc->triangleData(), fc->triangles(), fc->triangleStart(), fc->helpers());
+  else
+    triangulate();
+}
+
+
+MeshMap::MeshMap(const std::vector<double>& x, const std::vector<double>& y,
+		 const std::vector<double>& ex, const std::vector<double>& ey) {
+  std::shared_ptr<field_nodes_t> store = std::make_shared<field_nodes_t>();
+  store->x = x;
+  store->y = y;
+  store->ex = ex;
+  store->ey = ey;
+  share(store);
+  triangulate();
+}
+
+
+void MeshMap::share(std::shared_ptr<const field_nodes_t> store) {
+  nodes = store; // shared, not copied
+  nnodes = nodes->x.size();
+  allx = nodes->x.data();
+  ally = nodes->y.data();
+  alldx = nodes->ex.data();
+  alldy = nodes->ey.data();
+}
+
+
+double MeshMap::orient(int a, int b, double px, double py) const {
+  // > 0 for p left of a->b
+  return (nodex(b)-nodex(a))*(py-nodey(a)) - (nodey(b)-nodey(a))*(px-nodex(a));
+}
+
+
+bool MeshMap::incircle(int t, double px, double py) const {
+  // p strictly inside the circumcircle of counter-clockwise t,
+  // relative coordinates keep the determinant well scaled
+  const int* v = tris[t].v;
+  double ax = nodex(v[0])-px, ay = nodey(v[0])-py;
+  double bx = nodex(v[1])-px, by = nodey(v[1])-py;
+  double cx = nodex(v[2])-px, cy = nodey(v[2])-py;
+  double a2 = ax*ax + ay*ay;
+  double b2 = bx*bx + by*by;
+  double c2 = cx*cx + cy*cy;
+  return ax*(by*c2 - b2*cy) - ay*(bx*c2 - b2*cx) + a2*(bx*cy - by*cx) > 0.0;
+}
+
+
+int MeshMap::locate(int t, double px, double py) const {
+  // visibility walk, cross any edge p lies beyond; the
+  // rotating first edge avoids cycling on degenerate steps
+  int limit = (int)tris.size() + 3;
+  for (int step=0;step<limit;step++) {
+    const tri_t& tr = tris[t];
+    int next = -1;
+    for (int k=0;k<3;k++) {
+      int e = (k+step) % 3;
+      if (tr.nb[e]>=0 && orient(tr.v[(e+1)%3], tr.v[(e+2)%3], px, py) < 0.0) {
+	next = tr.nb[e];
+	break;
+      }
+    }
+    if (next<0) return t; // inside, or outside the outer hull
+    t = next;
+  }
+  return t;
+}
+
+
+int MeshMap::lowest(int t, double px, double py) const {
+  // p on an edge or a node lies in several triangles and the walk
+  // ends in any of them, depending on where it started; take the
+  // lowest index among them, the same for every thread
+  const tri_t& tr = tris[t];
+  bool shared = false;
+  for (int k=0;k<3;k++)
+    if (tr.nb[k]>=0 && orient(tr.v[(k+1)%3], tr.v[(k+2)%3], px, py) == 0.0) shared = true;
+  if (!shared) return t;
+
+  std::vector<int> fan(1, t); // triangles holding p, across edges through p
+  int best = t;
+  for (unsigned int i=0;i<fan.size();i++) {
+    const tri_t& f = tris[fan[i]];
+    for (int k=0;k<3;k++) {
+      int n = f.nb[k];
+      if (n<0 || orient(f.v[(k+1)%3], f.v[(k+2)%3], px, py) != 0.0) continue;
+      if (std::find(fan.begin(), fan.end(), n) != fan.end()) continue;
+      bool inside = true; // by the walk's own test
+      for (int j=0;j<3;j++)
+	if (tris[n].nb[j]>=0 && orient(tris[n].v[(j+1)%3], tris[n].v[(j+2)%3], px, py) < 0.0) inside = false;
+      if (!inside) continue;
+      fan.push_back(n);
+      best = std::min(best, n);
+    }
+  }
+  return best;
+}
+
+
+// position along a Hilbert curve on a 2^16 x 2^16 grid
+static unsigned long long hilbert(unsigned int x, unsigned int y) {
+  unsigned long long d = 0;
+  for (unsigned int s=1u<<15;s>0;s>>=1) {
+    unsigned int rx = (x & s) ? 1 : 0;
+    unsigned int ry = (y & s) ? 1 : 0;
+    d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+    if (ry==0) { // rotate the quadrant
+      if (rx==1) {
+	x = s-1 - (x & (s-1));
+	y = s-1 - (y & (s-1));
+      }
+      unsigned int t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+
+std::vector<int> spatial_order(const std::vector<double>& x, const std::vector<double>& y) {
+  double xmin, xmax, ymin, ymax;
+  node_bounds(x, y, xmin, xmax, ymin, ymax);
+  double scale = 65535.0 / std::max(std::max(xmax-xmin, ymax-ymin), 1.e-12);
+  std::vector<std::pair<unsigned long long,int> > keys(x.size());
+  for (unsigned int i=0;i<x.size();i++)
+    keys[i] = std::make_pair(hilbert((unsigned int)((x[i]-xmin)*scale), (unsigned int)((y[i]-ymin)*scale)), i);
+  std::sort(keys.begin(), keys.end()); // ties keep the input order
+  std::vector<int> order(x.size());
+  for (unsigned int i=0;i<x.size();i++) order[i] = keys[i].second;
+  return order;
+}
+
+
+void reorder(std::vector<double>& v, const std::vector<int>& order) {
+  std::vector<double> w(order.size());
+  for (unsigned int i=0;i<order.size();i++) w[i] = v[order[i]];
+  v.swap(w);
+}
+
+
+void MeshMap::triangulate() {
+  // Bowyer-Watson insertion along a Hilbert curve,
+  // consecutive nodes are close and the walks stay short
+  double xmin, xmax, ymin, ymax;
+  node_bounds(nodes->x, nodes->y, xmin, xmax, ymin, ymax);
+  std::vector<int> keys = spatial_order(nodes->x, nodes->y);
+
+  // enclosing triangle, helper nodes after the real ones
+  double cx = 0.5*(xmin+xmax);
+  double cy = 0.5*(ymin+ymax);
+  double size = 10.0 * std::max(xmax-xmin, ymax-ymin) + 1.0;
+  helperx[0] = cx-size;
+  helperx[1] = cx+size;
+  helperx[2] = cx;
+  helpery[0] = helpery[1] = cy-size;
+  helpery[2] = cy+size;
+  tris.clear();
+  tri_t first = {{nnodes, nnodes+1, nnodes+2}, {-1, -1, -1}};
+  tris.push_back(first);
+
+  std::vector<int> stamp(1, -1); // cavity membership per triangle
+  std::vector<int> freed; // reusable triangle slots
+  std::vector<int> cavity;
+  struct edge_t {int a; int b; int outside;};
+  std::vector<edge_t> boundary;
+  std::vector<int> created;
+  int last = 0;
+
+  for (int n=0;n<nnodes;n++) {
+    int ip = keys[n];
+    double px = nodex(ip);
+    double py = nodey(ip);
+    int t = locate(last, px, py);
+
+    bool duplicate = false; // COMSOL exports shared nodes more than once
+    for (int k=0;k<3;k++)
+      if (nodex(tris[t].v[k])==px && nodey(tris[t].v[k])==py) duplicate = true;
+    if (duplicate) continue;
+
+    // cavity: connected triangles whose circumcircle holds p
+    cavity.clear();
+    cavity.push_back(t);
+    stamp[t] = ip;
+    for (unsigned int c=0;c<cavity.size();c++)
+      for (int k=0;k<3;k++) {
+	int nb = tris[cavity[c]].nb[k];
+	if (nb>=0 && stamp[nb]!=ip && incircle(nb, px, py)) {
+	  stamp[nb] = ip;
+	  cavity.push_back(nb);
+	}
+      }
+
+    // rounding can admit a triangle p cannot see all edges of,
+    // drop those so the cavity stays star-shaped around p
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (unsigned int c=1;c<cavity.size() && !changed;c++) {
+	const tri_t& tr = tris[cavity[c]];
+	for (int k=0;k<3;k++) {
+	  int nb = tr.nb[k];
+	  if ((nb<0 || stamp[nb]!=ip) && orient(tr.v[(k+1)%3], tr.v[(k+2)%3], px, py) <= 0.0) {
+	    stamp[cavity[c]] = -1;
+	    cavity.erase(cavity.begin()+c);
+	    changed = true;
+	    break;
+	  }
+	}
+      }
+    }
+
+    boundary.clear();
+    for (int c : cavity)
+      for (int k=0;k<3;k++) {
+	int nb = tris[c].nb[k];
+	if (nb<0 || stamp[nb]!=ip) {
+	  edge_t e = {tris[c].v[(k+1)%3], tris[c].v[(k+2)%3], nb};
+	  boundary.push_back(e);
+	}
+      }
+    for (int c : cavity) freed.push_back(c);
+
+    // fan of new triangles (a, b, p) around the cavity boundary
+    created.clear();
+    for (edge_t& e : boundary) {
+      int nt;
+      if (!freed.empty()) {
+	nt = freed.back();
+	freed.pop_back();
+      }
+      else {
+	nt = tris.size();
+	tris.push_back(first);
+	stamp.push_back(-1);
+      }
+      tri_t& tr = tris[nt];
+      tr.v[0] = e.a;
+      tr.v[1] = e.b;
+      tr.v[2] = ip;
+      tr.nb[0] = tr.nb[1] = -1;
+      tr.nb[2] = e.outside;
+      stamp[nt] = -1;
+      if (e.outside>=0) { // by the shared edge, slots get reused
+	tri_t& out = tris[e.outside];
+	for (int k=0;k<3;k++)
+	  if (out.v[(k+1)%3]==e.b && out.v[(k+2)%3]==e.a) out.nb[k] = nt;
+      }
+      created.push_back(nt);
+    }
+    // link the fan: edge (b,p) meets the triangle starting at b
+    for (int i : created)
+      for (int j : created) {
+	if (tris[j].v[0]==tris[i].v[1]) tris[i].nb[0] = j;
+	if (tris[j].v[1]==tris[i].v[0]) tris[i].nb[1] = j;
+      }
+    last = created.front();
+  }
+
+  // freed slots stay unused, mark them for triangles()
+  for (int f : freed) tris[f].v[0] = -1;
+  start = last;
+  std::cout << "in MeshMap: " << triangles() << " triangles on " << nnodes << " nodes" << std::endl;
+}
+
+
+void MeshMap::field(double x, double y, double& ex, double& ey) {
+  // last triangle of this thread, meaningful if it came from this map
+  static thread_local const MeshMap* owner = 0;
+  static thread_local int hint = 0;
+  if (owner!=this || hint>=(int)tris.size() || tris[hint].v[0]<0) {
+    owner = this; // also a new map at a recycled address
+    hint = start;
+  }
+  int t = locate(hint, x, y);
+  hint = t;
+  t = lowest(t, x, y); // no dependence on the previous query
+
+  const int* v = tris[t].v;
+  double w[3];
+  double area = orient(v[0], v[1], nodex(v[2]), nodey(v[2]));
+  for (int k=0;k<3;k++)
+    w[k] = orient(v[(k+1)%3], v[(k+2)%3], x, y) / area;
+
+  // outside the node hull: only real nodes contribute
+  double wsum = 0.0;
+  for (int k=0;k<3;k++) {
+    if (v[k]>=nnodes || w[k]<0.0) w[k] = 0.0;
+    wsum += w[k];
+  }
+  if (wsum<=0.0) { // nearest real node of the triangle
+    for (int k=0;k<3;k++) w[k] = (v[k]<nnodes) ? 1.0 : 0.0;
+    wsum = w[0] + w[1] + w[2];
+  }
+  ex = 0.0;
+  ey = 0.0;
+  for (int k=0;k<3;k++) {
+    if (v[k]>=nnodes) continue; // helper, weight 0
+    ex += w[k] * alldx[v[k]];
+    ey += w[k] * alldy[v[k]];
+  }
+  ex /= wsum;
+  ey /= wsum;
+}
+
+
+void MeshMap::adopt(const int* data, int ntri, int s, const double* helpers) {
+  // triangulation stored earlier for the same nodes
+  for (int k=0;k<3;k++) {
+    helperx[k] = helpers[2*k];
+    helpery[k] = helpers[2*k+1];
+  }
+  tris.resize(ntri);
+  for (int t=0;t<ntri;t++)
+    for (int k=0;k<3;k++) {
+      tris[t].v[k] = data[6*t+k];
+      tris[t].nb[k] = data[6*t+3+k];
+    }
+  start = s;
+}
+
+
+void MeshMap::exportMesh(std::vector<int>& data, int& s, double* helpers) {
+  data.resize(6*tris.size());
+  for (size_t t=0;t<tris.size();t++)
+    for (int k=0;k<3;k++) {
+      data[6*t+k] = tris[t].v[k];
+      data[6*t+3+k] = tris[t].nb[k];
+    }
+  s = start;
+  for (int k=0;k<3;k++) {
+    helpers[2*k] = helperx[k];
+    helpers[2*k+1] = helpery[k];
+  }
+}
+
+
+size_t MeshMap::memory() {
+  // node arrays shared with the other maps, counted as by KDTreeMap
+  return 4 * nnodes * sizeof(double) + tris.size() * sizeof(tri_t);
+}
+
+
+int MeshMap::triangles() {
+  int count = 0;
+  for (tri_t& tr : tris)
+    if (tr.v[0]>=0 && tr.v[0]<nnodes && tr.v[1]<nnodes && tr.v[2]<nnodes) count++;
+  return count;
+}
+
+
+//***********
+// Quadtree
+//***********
+QuadTreeMap::QuadTreeMap(FieldMap* source, GeometryModel* gm, double tol, int maxdepth) {
+  double xmax, ymax;
+  gm->comsolBounds(x0, xmax, y0, ymax);
+  width = xmax - x0;
+  height = ymax - y0;
+  wires = gm->wireList();
+  build(source, tol, maxdepth);
+}
+
+
+QuadTreeMap::QuadTreeMap(FieldMap* source, double xmin, double xmax, double ymin, double ymax,
+			 const std::vector<wire_t>& wl, double tol, int maxdepth) {
+  x0 = xmin;
+  y0 = ymin;
+  width = xmax - xmin;
+  height = ymax - ymin;
+  wires = wl;
+  build(source, tol, maxdepth);
+}
+
+
+void QuadTreeMap::build(FieldMap* source, double tol, int maxdepth) {
+  int mindepth = 4; // no early accept on lucky test points
+  double rmin = 1.e30; // thinnest wire
+  for (wire_t& wr : wires) rmin = std::min(rmin, wr.r);
+
+  // field scale, the tolerance is relative to |E| but not below
+  // a percent of the mean to stop splitting at field zeros
+  double ex, ey;
+  double mean = 0.0;
+  for (int j=0;j<32;j++)
+    for (int i=0;i<32;i++) {
+      source->field(x0 + (i+0.5)*width/32, y0 + (j+0.5)*height/32, ex, ey);
+      mean += std::sqrt(ex*ex + ey*ey) / 1024.0;
+    }
+  double floor = 0.01 * mean;
+
+  // cells to look at: node, depth, lower left corner
+  struct cell_t {int node; int level; double x; double y;};
+  std::vector<cell_t> work;
+  qnode_t root = {-1, -1};
+  nodes.push_back(root);
+  cell_t first = {0, 0, x0, y0};
+  work.push_back(first);
+  depth = 0;
+
+  double cex[4], cey[4];
+  while (!work.empty()) {
+    cell_t c = work.back();
+    work.pop_back();
+    double w = width / (1 << c.level);
+    double h = height / (1 << c.level);
+    for (int k=0;k<4;k++)
+      source->field(c.x + (k%2)*w, c.y + (k/2)*h, cex[k], cey[k]);
+
+    bool split = (c.level < mindepth);
+    if (!split && c.level < maxdepth) {
+      // graded towards the wires, cells no larger than their
+      // distance to a wire until they reach the wire radius
+      double size = std::max(w, h);
+      double dwire = nearwire(c.x, c.x+w, c.y, c.y+h);
+      if (size > rmin && dwire < size) split = true;
+      // bilinear against the source at centre and edge midpoints
+      static const double tx[5] = {0.5, 0.5, 0.0, 1.0, 0.5};
+      static const double ty[5] = {0.5, 0.0, 0.5, 0.5, 1.0};
+      for (int t=0;t<5 && !split;t++) {
+	double px = c.x + tx[t]*w;
+	double py = c.y + ty[t]*h;
+	if (dwire<=0.0 && inwire(px, py)) continue; // no field inside conductors
+	double fx, fy;
+	source->field(px, py, fx, fy);
+	double w00 = (1.0-tx[t])*(1.0-ty[t]);
+	double w10 = tx[t]*(1.0-ty[t]);
+	double w01 = (1.0-tx[t])*ty[t];
+	double w11 = tx[t]*ty[t];
+	double bx = w00*cex[0] + w10*cex[1] + w01*cex[2] + w11*cex[3];
+	double by = w00*cey[0] + w10*cey[1] + w01*cey[2] + w11*cey[3];
+	double dev = std::sqrt((bx-fx)*(bx-fx) + (by-fy)*(by-fy));
+	if (dev > tol * (std::sqrt(fx*fx + fy*fy) + floor)) split = true;
+      }
+    }
+
+    if (split) { // four children, stored next to each other
+      int first = nodes.size();
+      nodes[c.node].child = first;
+      for (int k=0;k<4;k++) {
+	nodes.push_back(root);
+	cell_t cc = {first+k, c.level+1, c.x + (k%2)*0.5*w, c.y + (k/2)*0.5*h};
+	work.push_back(cc);
+      }
+    }
+    else {
+      nodes[c.node].leaf = corners.size() / 8;
+      for (int k=0;k<4;k++) corners.push_back(cex[k]);
+      for (int k=0;k<4;k++) corners.push_back(cey[k]);
+      if (c.level > depth) depth = c.level;
+    }
+  }
+  std::cout << "in QuadTreeMap: " << leaves() << " leaves, depth " << depth << std::endl;
+}
+
+
+bool QuadTreeMap::inwire(double x, double y) {
+  for (wire_t& w : wires)
+    if ((x-w.x)*(x-w.x) + (y-w.y)*(y-w.y) < w.r*w.r) return true;
+  return false;
+}
+
+
+double QuadTreeMap::nearwire(double xl, double xh, double yl, double yh) {
+  // distance from the cell to the closest wire surface [cm]
+  double best = 1.e30;
+  for (wire_t& w : wires) {
+    double dx = std::max(0.0, std::max(xl - w.x, w.x - xh));
+    double dy = std::max(0.0, std::max(yl - w.y, w.y - yh));
+    double d = std::sqrt(dx*dx + dy*dy) - w.r;
+    if (d < best) best = d;
+  }
+  return std::max(best, 0.0);
+}
+
+
+void QuadTreeMap::field(double x, double y, double& ex, double& ey) {
+  // descend to the leaf, fx, fy end up as the position in it
+  double fx = (x - x0) / width;
+  double fy = (y - y0) / height;
+  fx = std::min(std::max(fx, 0.0), 1.0);
+  fy = std::min(std::max(fy, 0.0), 1.0);
+  int n = 0;
+  while (nodes[n].child >= 0) {
+    fx *= 2.0;
+    fy *= 2.0;
+    int ix = (fx >= 1.0) ? 1 : 0;
+    int iy = (fy >= 1.0) ? 1 : 0;
+    fx -= ix;
+    fy -= iy;
+    n = nodes[n].child + ix + 2*iy;
+  }
+  const double* c = &corners[8 * nodes[n].leaf];
+  double w00 = (1.0-fx)*(1.0-fy);
+  double w10 = fx*(1.0-fy);
+  double w01 = (1.0-fx)*fy;
+  double w11 = fx*fy;
+  ex = w00*c[0] + w10*c[1] + w01*c[2] + w11*c[3];
+  ey = w00*c[4] + w10*c[5] + w01*c[6] + w11*c[7];
+}
+
+
+size_t QuadTreeMap::memory() {
+  return nodes.size() * sizeof(qnode_t) + corners.size() * sizeof(double);
+}
+
+
+//***********
+// Tiled grid
+//***********
+struct tile_header_t {
+  char magic[8];          // "SNDTILE"
+  uint32_t version;
+  int32_t cells;          // per tile side
+  uint64_t source_size;   // [bytes] of the field file
+  int64_t source_mtime;   // [s]
+  int32_t nx;             // grid nodes
+  int32_t ny;
+  int32_t ntx;            // tiles
+  int32_t nty;
+  double x0;              // [cm]
+  double y0;
+  double step;            // [cm]
+  double request;         // step asked for, 0: node spacing
+  double bias;            // [V] of the sampled map
+  uint64_t tilebytes;     // page aligned
+  uint64_t offset;        // first tile, page aligned
+};
+
+static const uint32_t tile_version = 2; // 2: tiles in Morton order
+static const size_t tile_page = 4096;
+
+
+// bilinear inside a tile of interleaved ex, ey node pairs, any storage type;
+// tiles share their edge nodes, the cell is inside one
+template <typename T>
+static inline void tile_field(const T* d, int cells, int li, int lj, double fx, double fy,
+			      double& ex, double& ey) {
+  int row = 2*(cells+1);
+  int n = lj*row + 2*li;
+  double w00 = (1.0-fx)*(1.0-fy);
+  double w10 = fx*(1.0-fy);
+  double w01 = (1.0-fx)*fy;
+  double w11 = fx*fy;
+  ex = w00*d[n] + w10*d[n+2] + w01*d[n+row] + w11*d[n+row+2];
+  ey = w00*d[n+1] + w10*d[n+3] + w01*d[n+row+1] + w11*d[n+row+3];
+}
+
+
+// position along a Z-order (Morton) curve, bits of x and y interleaved
+static unsigned long long morton(unsigned int x, unsigned int y) {
+  unsigned long long d = 0;
+  for (int b=0;b<16;b++)
+    d |= (unsigned long long)((x >> b) & 1u) << (2*b) | (unsigned long long)((y >> b) & 1u) << (2*b+1);
+  return d;
+}
+
+
+// storage slot of each row-major tile: tiles follow a Morton curve,
+// neighbouring tiles are close in memory and in the file
+static std::vector<int> morton_slots(int ntx, int nty) {
+  std::vector<std::pair<unsigned long long,int> > keys;
+  for (int ty=0;ty<nty;ty++)
+    for (int tx=0;tx<ntx;tx++)
+      keys.push_back(std::make_pair(morton(tx, ty), ty*ntx + tx));
+  std::sort(keys.begin(), keys.end());
+  std::vector<int> slots(keys.size());
+  for (unsigned int i=0;i<keys.size();i++) slots[keys[i].second] = i;
+  return slots;
+}
+
+
+// nodes of row-major tile k sampled from map
+static void tile_sample(FieldMap* map, const grid_geometry_t& g, int k, double* d) {
+  int c = g.cells;
+  int tx = k % g.ntx;
+  int ty = k / g.ntx;
+  for (int lj=0;lj<=c;lj++)
+    for (int li=0;li<=c;li++) {
+      int n = 2*(lj*(c+1) + li);
+      map->field(g.x0 + (tx*c + li)*g.step, g.y0 + (ty*c + lj)*g.step, d[n], d[n+1]);
+    }
+}
+
+
+struct TileMap::tile_cache_t {
+  struct entry_t {
+    int tile;
+    void* base;
+    unsigned long long last; // use clock
+  };
+  std::vector<int> slot; // per tile: entry or -1
+  std::vector<entry_t> entries;
+  unsigned long long clock;
+  int current; // last tile asked, fast path
+  const double* data;
+  // written by the owning thread only, read by tileStats()
+  std::atomic<unsigned long long> hits;
+  std::atomic<unsigned long long> misses;
+  std::atomic<unsigned long long> evictions;
+
+  // entries.size(), for memory() on other threads
+  std::atomic<size_t> mapped;
+
+  tile_cache_t(int ntiles) : slot(ntiles, -1), clock(0), current(-1), data(0),
+			     hits(0), misses(0), evictions(0), mapped(0) {}
+
+  void release(size_t tilebytes) {
+    for (entry_t& e : entries) munmap(e.base, tilebytes);
+    entries.clear();
+  }
+};
+
+
+struct TileMap::tile_shared_t {
+  std::mutex lock;
+  std::vector<tile_cache_t*> caches; // of live threads
+  std::atomic<bool> alive; // false once the map is deleted
+  size_t tilebytes;
+  // counters of threads that ended, for tileStats()
+  unsigned long long hits, misses, evictions;
+
+  tile_shared_t(size_t bytes) : alive(true), tilebytes(bytes), hits(0), misses(0), evictions(0) {}
+};
+
+
+// the tile caches of one thread, unmapped when the thread ends
+struct TileMap::tile_owner_t {
+  std::vector<std::pair<std::shared_ptr<tile_shared_t>, tile_cache_t*> > mine;
+
+  ~tile_owner_t() {
+    for (std::pair<std::shared_ptr<tile_shared_t>, tile_cache_t*>& m : mine) {
+      tile_shared_t& sh = *m.first;
+      std::lock_guard<std::mutex> lock(sh.lock);
+      if (!sh.alive) continue; // the map released it already
+      sh.caches.erase(std::find(sh.caches.begin(), sh.caches.end(), m.second));
+      sh.hits += m.second->hits.load(std::memory_order_relaxed);
+      sh.misses += m.second->misses.load(std::memory_order_relaxed);
+      sh.evictions += m.second->evictions.load(std::memory_order_relaxed);
+      m.second->release(sh.tilebytes);
+      delete m.second;
+    }
+  }
+};
+
+
+static bool tile_header(std::string fname, tile_header_t& h) {
+  std::ifstream in(fname.c_str(), std::ios::binary);
+  if (!in) return false;
+  in.read((char*)&h, sizeof(h));
+  return in && std::strncmp(h.magic, "SNDTILE", 8)==0 && h.version==tile_version;
+}
+
+
+// every tile the header promises inside a file of length [bytes]
+static bool tile_fits(uint64_t length, const tile_header_t& h) {
+  if (h.ntx<=0 || h.nty<=0) return false;
+  return file_holds(length, h.offset, (uint64_t)h.ntx * (uint64_t)h.nty * h.tilebytes);
+}
+
+
+bool TileMap::current(std::string fname, std::string source, double st, int c) {
+  tile_header_t h;
+  uint64_t size, tsize;
+  int64_t mtime, tmtime;
+  if (!tile_header(fname, h) || !file_stamp(source, size, mtime)) return false;
+  if (!file_stamp(fname, tsize, tmtime) || !tile_fits(tsize, h)) return false; // cut short
+  return h.source_size==size && h.source_mtime==mtime && h.request==st && h.cells==c;
+}
+
+
+bool TileMap::write(std::string fname, std::string source, FieldMap* map,
+		    double xmin, double xmax, double ymin, double ymax,
+		    double st, double request, int c, double bias) {
+  tile_header_t h;
+  std::memset(&h, 0, sizeof(h));
+  std::strncpy(h.magic, "SNDTILE", 8);
+  h.version = tile_version;
+  if (!file_stamp(source, h.source_size, h.source_mtime)) return false;
+  grid_geometry_t g;
+  g.set(xmin, xmax, ymin, ymax, st, c);
+  h.cells = g.cells;
+  h.nx = g.nx;
+  h.ny = g.ny;
+  h.ntx = g.ntx;
+  h.nty = g.nty;
+  h.x0 = g.x0;
+  h.y0 = g.y0;
+  h.step = g.step;
+  h.request = request;
+  h.bias = bias;
+  size_t raw = 2 * (size_t)(c+1) * (c+1) * sizeof(double); // ex, ey pairs
+  h.tilebytes = (raw + tile_page - 1) / tile_page * tile_page;
+  h.offset = tile_page;
+
+  // one tile in memory at a time, the grid may not fit
+  FileWriter w(fname);
+  if (!w.good()) return false;
+  std::vector<char> pad(h.offset - sizeof(h), 0);
+  w.out.write((const char*)&h, sizeof(h));
+  w.out.write(pad.data(), pad.size());
+  std::vector<double> data(h.tilebytes / sizeof(double), 0.0);
+  std::vector<int> slots = morton_slots(h.ntx, h.nty);
+  std::vector<int> tileat(slots.size()); // inverse: tile in each slot
+  for (unsigned int k=0;k<slots.size();k++) tileat[slots[k]] = k;
+  for (int k : tileat) {
+    tile_sample(map, g, k, data.data());
+    w.out.write((const char*)data.data(), h.tilebytes);
+  }
+  if (!w.commit()) return false;
+  std::cout << "in TileMap: " << h.nx << " x " << h.ny << " nodes in "
+	    << h.ntx*h.nty << " tiles, step [cm] " << st << std::endl;
+  return true;
+}
+
+
+TileMap::TileMap(std::string fname, double bias, double mb) {
+  budget = (size_t)(mb * 1048576.0);
+  tile_header_t h;
+  fd = -1;
+  scale = 1.0;
+  tilebytes = offset = 0;
+  if (!tile_header(fname, h)) {
+    std::cout << "Error: no tiled field map in " << fname << std::endl;
+    return;
+  }
+  grid.cells = h.cells; // as written, not recomputed
+  grid.nx = h.nx;
+  grid.ny = h.ny;
+  grid.ntx = h.ntx;
+  grid.nty = h.nty;
+  grid.x0 = h.x0;
+  grid.y0 = h.y0;
+  grid.step = h.step;
+  grid.inverse = 1.0 / h.step;
+  scale = (h.bias!=0.0) ? bias / h.bias : 1.0;
+  tilebytes = h.tilebytes;
+  offset = h.offset;
+  slots = morton_slots(grid.ntx, grid.nty);
+  shared = std::make_shared<tile_shared_t>(tilebytes);
+  fd = open(fname.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd>=0 && (fstat(fd, &st)!=0 || !tile_fits(st.st_size, h))) {
+    // mapping a tile past the end would fault at first touch
+    std::cout << "Error: tiled field map " << fname << " is shorter than its header" << std::endl;
+    close(fd);
+    fd = -1;
+  }
+}
+
+
+TileMap::~TileMap() {
+  if (shared) { // threads still running drop their entries later
+    std::lock_guard<std::mutex> lock(shared->lock);
+    for (tile_cache_t* c : shared->caches) {
+      c->release(tilebytes);
+      delete c;
+    }
+    shared->caches.clear();
+    shared->alive = false;
+  }
+  if (fd>=0) close(fd);
+}
+
+
+TileMap::tile_cache_t* TileMap::mycache() {
+  // entries hold the shared block, its address can not alias a new map
+  static thread_local tile_owner_t owner;
+  std::vector<std::pair<std::shared_ptr<tile_shared_t>, tile_cache_t*> >& mine = owner.mine;
+  for (std::pair<std::shared_ptr<tile_shared_t>, tile_cache_t*>& m : mine)
+    if (m.first==shared) return m.second;
+  // drop the entries of deleted maps, their caches are gone
+  for (unsigned int i=0;i<mine.size();)
+    if (!mine[i].first->alive) mine.erase(mine.begin()+i);
+    else i++;
+  tile_cache_t* c = new tile_cache_t(grid.tiles());
+  {
+    std::lock_guard<std::mutex> lock(shared->lock);
+    shared->caches.push_back(c);
+  }
+  mine.push_back(std::make_pair(shared, c));
+  return c;
+}
+
+
+const double* TileMap::tile(tile_cache_t* c, int k) {
+  // counters: owner thread only, no locked increment needed
+  if (k==c->current) {
+    c->hits.store(c->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return c->data;
+  }
+  int e = c->slot[k];
+  if (e>=0)
+    c->hits.store(c->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  else {
+    c->misses.store(c->misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    void* base = mmap(0, tilebytes, PROT_READ, MAP_SHARED, fd, offset + (size_t)slots[k] * tilebytes);
+    if (base==MAP_FAILED) { // address space or file gone, nothing sensible left
+      std::cout << "Error: cannot map field tile " << k << std::endl;
+      std::abort();
+    }
+    if ((c->entries.size()+1) * tilebytes > budget && !c->entries.empty()) {
+      // over budget: reuse the least recently used entry
+      e = 0;
+      for (unsigned int i=1;i<c->entries.size();i++)
+	if (c->entries[i].last < c->entries[e].last) e = i;
+      munmap(c->entries[e].base, tilebytes);
+      c->slot[c->entries[e].tile] = -1;
+      c->evictions.store(c->evictions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    else {
+      e = c->entries.size();
+      c->entries.push_back(tile_cache_t::entry_t());
+      c->mapped.store(c->entries.size(), std::memory_order_relaxed);
+    }
+    c->entries[e].tile = k;
+    c->entries[e].base = base;
+    c->slot[k] = e;
+  }
+  c->entries[e].last = ++c->clock;
+  c->current = k;
+  c->data = (const double*)c->entries[e].base;
+  return c->data;
+}
+
+
+void TileMap::field(double x, double y, double& ex, double& ey) {
+  int i, j;
+  double fx, fy;
+  grid.cell(x, y, i, j, fx, fy);
+  int cells = grid.cells;
+  int tx = i / cells;
+  int ty = j / cells;
+  tile_field(tile(mycache(), ty*grid.ntx + tx), cells, i - tx*cells, j - ty*cells, fx, fy, ex, ey);
+  ex *= scale;
+  ey *= scale;
+}
+
+
+size_t TileMap::memory() {
+  // the lock keeps the caches alive, their entries are read
+  // through the atomic count only, owners change them unlocked
+  if (!shared) return 0;
+  std::lock_guard<std::mutex> lock(shared->lock);
+  size_t bytes = 0;
+  for (tile_cache_t* c : shared->caches)
+    bytes += c->mapped.load(std::memory_order_relaxed) * tilebytes + c->slot.size() * sizeof(int);
+  return bytes;
+}
+
+
+void TileMap::tileStats(unsigned long long& hits, unsigned long long& misses, unsigned long long& evictions) {
+  hits = misses = evictions = 0;
+  if (!shared) return;
+  std::lock_guard<std::mutex> lock(shared->lock);
+  hits = shared->hits; // threads ended
+  misses = shared->misses;
+  evictions = shared->evictions;
+  for (tile_cache_t* c : shared->caches) {
+    hits += c->hits.load(std::memory_order_relaxed);
+    misses += c->misses.load(std::memory_order_relaxed);
+    evictions += c->evictions.load(std::memory_order_relaxed);
+  }
+}
+
+
+//***********
+// Lazy grid
+//***********
+LazyGridMap::LazyGridMap(std::shared_ptr<FieldMap> src, double xmin, double xmax, double ymin, double ymax,
+			 double st, int c) : nbuilt(0) {
+  source = src;
+  grid.set(xmin, xmax, ymin, ymax, st, c);
+  table = new std::atomic<const double*> [grid.tiles()];
+  for (int k=0;k<grid.tiles();k++) table[k].store(0);
+}
+
+
+LazyGridMap::~LazyGridMap() {
+  for (int k=0;k<grid.tiles();k++) delete [] table[k].load();
+  delete [] table;
+}
+
+
+const double* LazyGridMap::fill(int k) {
+  // threads meeting an empty tile may all sample it,
+  // the first to publish wins and the others drop theirs
+  double* d = new double [2*(grid.cells+1)*(grid.cells+1)];
+  tile_sample(source.get(), grid, k, d);
+  const double* empty = 0;
+  if (table[k].compare_exchange_strong(empty, d, std::memory_order_acq_rel)) {
+    nbuilt++;
+    return d;
+  }
+  delete [] d;
+  return empty; // the winner's tile
+}
+
+
+void LazyGridMap::field(double x, double y, double& ex, double& ey) {
+  int i, j;
+  double fx, fy;
+  grid.cell(x, y, i, j, fx, fy);
+  int cells = grid.cells;
+  int tx = i / cells;
+  int ty = j / cells;
+  int k = ty*grid.ntx + tx;
+  const double* d = table[k].load(std::memory_order_acquire);
+  if (!d) d = fill(k);
+  tile_field(d, cells, i - tx*cells, j - ty*cells, fx, fy, ex, ey);
+}
+
+
+size_t LazyGridMap::memory() {
+  return (size_t)nbuilt.load() * 2*(grid.cells+1)*(grid.cells+1) * sizeof(double)
+    + grid.tiles() * sizeof(std::atomic<const double*>);
+}
+
+
+//***********
+// Compact grid
+//***********
+CompactGridMap::CompactGridMap(FieldMap* source, double xmin, double xmax, double ymin, double ymax,
+			       double st, int s, bool curve) {
+  storage = s;
+  grid.set(xmin, xmax, ymin, ymax, st, 16, grid_max_nodes); // as GridMap
+  int ntiles = grid.tiles();
+  if (curve)
+    slots = morton_slots(grid.ntx, grid.nty);
+  else { // row by row, slot k for tile k
+    slots.resize(ntiles);
+    for (int k=0;k<ntiles;k++) slots[k] = k;
+  }
+  int pairs = (grid.cells+1)*(grid.cells+1);
+
+  // tile after tile, each sampled in double and then stored
+  std::vector<double> d(2*pairs);
+  if (storage==storage_int16) {
+    qdata.resize(2*(size_t)pairs*ntiles);
+    qscale.resize(ntiles);
+  }
+  else
+    fdata.resize(2*(size_t)pairs*ntiles);
+  for (int k=0;k<ntiles;k++) {
+    tile_sample(source, grid, k, d.data());
+    size_t at = 2*(size_t)pairs*slots[k];
+    if (storage==storage_int16) {
+      double peak = 0.0; // per tile, wire tiles get a coarse scale
+      for (double v : d) peak = std::max(peak, std::fabs(v));
+      double sc = (peak>0.0) ? peak / 32767.0 : 1.0;
+      qscale[slots[k]] = sc;
+      for (int n=0;n<2*pairs;n++)
+	qdata[at+n] = (int16_t)std::lround(d[n] / sc);
+    }
+    else
+      for (int n=0;n<2*pairs;n++)
+	fdata[at+n] = (float)d[n];
+  }
+  std::cout << "in CompactGridMap: " << grid.nx << " x " << grid.ny << " nodes, step [cm] " << grid.step
+	    << ((storage==storage_int16) ? ", 16 bit" : ", float") << std::endl;
+}
+
+
+void CompactGridMap::field(double x, double y, double& ex, double& ey) {
+  int i, j;
+  double fx, fy;
+  grid.cell(x, y, i, j, fx, fy);
+  int cells = grid.cells;
+  int tx = i / cells;
+  int ty = j / cells;
+  int k = slots[ty*grid.ntx + tx];
+  size_t at = 2*(size_t)(cells+1)*(cells+1)*k;
+  if (storage==storage_int16) {
+    tile_field(&qdata[at], cells, i - tx*cells, j - ty*cells, fx, fy, ex, ey);
+    ex *= qscale[k];
+    ey *= qscale[k];
+  }
+  else
+    tile_field(&fdata[at], cells, i - tx*cells, j - ty*cells, fx, fy, ex, ey);
+}
+
+
+size_t CompactGridMap::memory() {
+  return fdata.size() * sizeof(float) + qdata.size() * sizeof(int16_t) + qscale.size() * sizeof(float)
+    + slots.size() * sizeof(int);
+}
@@ -1,7 +1,13 @@
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
 
 // us
 #include "fields.hh"
+#include "fieldmap.hh"
+#include "fieldcache.hh"
 
 // ROOT includes
 #include "TFile.h"
@@ -11,15 +17,58 @@
 ComsolFields::ComsolFields(TString fn) {
   bias = 1.0;
   fname = fn;
-  coords.clear();
-  dmap.clear();
+  standalone = fn.EndsWith(".fmap"); // from comsol2fmap.exe, no ROOT file
+  cachename = standalone ? std::string(fn.Data()) : std::string(fn.Data()) + ".fmap";
+  usecache = true;
+  fcache = 0; // null ptr
+  tilebudget = 64.0; // [MB] per thread
+  lazysource = kdtree_idw;
+  storage = storage_double;
+  spatial = true;
+}
+
+
+ComsolFields::~ComsolFields() {
+  if (fcache) delete fcache;
 }
 
 
 // come now as 2D data in x,y from comsol
 void ComsolFields::read_fields() {
-  Point3 p;
-  Point3 pe;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::shared_ptr<field_nodes_t> nodes = std::make_shared<field_nodes_t>();
+  if (fcache) delete fcache;
+  fcache = 0;
+
+  if ((usecache && spatial) || standalone) { // no ROOT I/O while the cache is current
+    fcache = new FieldCache(cachename, standalone ? "" : fname.Data());
+    if (fcache->valid()) {
+      int entries = fcache->nodes();
+      nodes->x.assign(fcache->x(), fcache->x()+entries); // [cm] already
+      nodes->y.assign(fcache->y(), fcache->y()+entries);
+      nodes->ex.resize(entries);
+      nodes->ey.resize(entries);
+      const double* cex = fcache->ex();
+      const double* cey = fcache->ey();
+      for (int i=0;i<entries;i++){
+	nodes->ex[i] = bias*cex[i]; // bias applied here, cache is unscaled
+	nodes->ey[i] = bias*cey[i];
+      }
+      store = nodes;
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "in Comsol Fields: read field entries " << entries
+		<< " from cache " << cachename << " in [s] " << elapsed
+		<< ", peak memory [MB] " << peak_memory() << std::endl;
+      return;
+    }
+    delete fcache;
+    fcache = 0;
+  }
+  if (standalone) {
+    std::cout << "Error: no valid field map in " << cachename
+	      << ", missing or of another format version, convert it again with comsol2fmap.exe" << std::endl;
+    return;
+  }
 
   TFile* ffd = new TFile(fname.Data(),"read");
   TNtupleD* ntd = (TNtupleD*)ffd->Get("drift");
@@ -34,84 +83,196 @@ void ComsolFields::read_fields() {
   ntd->SetBranchAddress("ex",&wx);
   ntd->SetBranchAddress("ey",&wy);
 
+  std::vector<double> rex, rey; // unscaled for the cache
+  nodes->x.reserve(entries);
+  nodes->y.reserve(entries);
+  nodes->ex.reserve(entries);
+  nodes->ey.reserve(entries);
 
   // comsol y-coord becomes z-coord in geometry
   for (int i=0;i<entries;i++){
     ntd->GetEntry(i);
-    p.Set(x*1.0e2, y*1.0e2, 0.0); // [m]->[cm]
-    coords.push_back(p);
-    pe.Set(bias*wx, bias*wy, 0.0); // electrode weighting to drift
-    dmap.push_back(pe);
+    nodes->x.push_back(x*1.0e2); // [m]->[cm]
+    nodes->y.push_back(y*1.0e2);
+    nodes->ex.push_back(bias*wx); // electrode weighting to drift
+    nodes->ey.push_back(bias*wy);
+    rex.push_back(wx);
+    rey.push_back(wy);
   }
-  std::cout << "in Comsol Fields: read field entries " << entries << std::endl;
+  if (spatial) { // neighbours in space next to each other in memory
+    std::vector<int> order = spatial_order(nodes->x, nodes->y);
+    reorder(nodes->x, order);
+    reorder(nodes->y, order);
+    reorder(nodes->ex, order);
+    reorder(nodes->ey, order);
+    reorder(rex, order);
+    reorder(rey, order);
+  }
+  store = nodes;
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "in Comsol Fields: read field entries " << entries << " in [s] " << elapsed
+	    << ", peak memory [MB] " << peak_memory() << std::endl;
   // all done and in memory
   ffd->Close();
+
+  if (usecache && spatial && !file_writable(cachename))
+    std::cout << "in Comsol Fields: cannot write cache " << cachename << ", continue without" << std::endl;
+  else if (usecache && spatial) { // triangulate once, every later start maps the result
+    MeshMap mesh(nodes->x, nodes->y, rex, rey);
+    std::vector<int> tris;
+    int tstart;
+    double helpers[6];
+    mesh.exportMesh(tris, tstart, helpers);
+    if (FieldCache::write(cachename, fname.Data(), nodes->x, nodes->y, rex, rey, tris, tstart, helpers)) {
+      fcache = new FieldCache(cachename, fname.Data());
+      if (!fcache->valid()) {
+	delete fcache;
+	fcache = 0;
+      }
+      std::cout << "in Comsol Fields: wrote cache " << cachename << std::endl;
+    }
+    else
+      std::cout << "in Comsol Fields: cannot write cache " << cachename << ", continue without" << std::endl;
+  }
 }
 
 
-Fields::Fields(ComsolFields* fem, GeometryModel* g) {
-  gm = g; // have access to geometry model
+std::shared_ptr<FieldMap> ComsolFields::fieldMap(GeometryModel* gm, int method, double step) {
+  std::lock_guard<std::mutex> lock(maplock); // Electrodes may initialise on any thread
+  return shared_map(gm, method, step);
+}
 
-  allx = 0; // null ptr
-  ally = 0;
-  alldx = 0;
-  alldy = 0;
-  
-  prepare_fields(fem);
+
+int ComsolFields::lazy_source(int method) {
+  if (method!=lazy_grid) return kdtree_idw; // no source map
+  return (lazysource==triangle_mesh) ? triangle_mesh : kdtree_idw;
 }
 
-Fields::~Fields() {
-  if (allx) { // all set together
-    delete [] allx ;
-    delete [] ally ;
-    delete [] alldx;
-    delete [] alldy;
+
+std::shared_ptr<FieldMap> ComsolFields::shared_map(GeometryModel* gm, int method, double step) {
+  // maplock held
+  int st = (method==uniform_grid) ? storage : storage_double; // others always double
+  int src = lazy_source(method);
+  for (map_entry_t& entry : maps) {
+    if (entry.method!=method || entry.step!=step || entry.storage!=st || entry.source!=src) continue;
+    std::shared_ptr<FieldMap> shared = entry.map.lock();
+    if (shared) return shared; // built before and still in use
   }
-  if (coordinates) delete coordinates;
+  if (!store) read_fields(); // released before
+  if (!store || store->x.empty()) { // no Fields can work without a map
+    std::cout << "Error: no field nodes to build a map from" << std::endl;
+    std::abort();
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::shared_ptr<FieldMap> built(build_map(gm, method, step));
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "in Comsol Fields: field map " << method << " built in [s] " << elapsed
+	    << ", map [MB] " << built->memory()/1048576.0
+	    << ", peak memory [MB] " << peak_memory() << std::endl;
+
+  map_entry_t entry;
+  entry.method = method;
+  entry.step = step;
+  entry.storage = st;
+  entry.source = src;
+  entry.map = built;
+  maps.push_back(entry);
+  return built;
 }
 
-void Fields::prepare_fields(ComsolFields* fem) {
-  std::vector<Point3> cdata = fem->positions();
-  int nentries = cdata.size();
-  //  std::cout << "in Fields::prepare fields." << std::endl;
 
-  coordinates = new TKDTreeID(nentries,2,1);
-  
-  allx = new double [nentries];
-  ally = new double [nentries];
-
-  for (int i=0;i<nentries;i++){
-    // no transf needed, requests come as vectors
-    allx[i] = cdata[i].xc();
-    ally[i] = cdata[i].yc();
-  }
-  coordinates->SetData(0,allx);
-  coordinates->SetData(1,ally);
-  coordinates->Build();
-
-  alldx = new double [nentries];
-  alldy = new double [nentries];
-
-  std::vector<Point3> ddata = fem->driftmap();
-  for (int i=0;i<nentries;i++){
-    alldx[i] = ddata[i].xc();
-    alldy[i] = ddata[i].yc();
-  }  
-  // all done and in memory
+FieldMap* ComsolFields::build_map(GeometryModel* gm, int method, double step) {
+  if (method==triangle_mesh) // nodes only, no tree
+    return new MeshMap(this);
+  if (method==quadtree) { // refined from the linear mesh interpolation
+    MeshMap mesh(this);
+    return new QuadTreeMap(&mesh, gm, (step>0.0) ? step : 0.01);
+  }
+  if (method==tiled_grid) { // on disk next to the field file, tiles mapped on demand
+    std::string tname = std::string(fname.Data()) + ".ftile";
+    if (!TileMap::current(tname, fname.Data(), step, 64)) {
+      KDTreeMap kdmap(this);
+      double xmin, xmax, ymin, ymax;
+      kdmap.bounds(xmin, xmax, ymin, ymax);
+      if (!TileMap::write(tname, fname.Data(), &kdmap, xmin, xmax, ymin, ymax,
+			  (step>0.0) ? step : kdmap.spacing(), step, 64, bias))
+	std::cout << "Error: cannot write tiled field map " << tname << std::endl;
+    }
+    TileMap* tiles = new TileMap(tname, bias, tilebudget);
+    if (tiles->valid()) return tiles;
+    delete tiles; // e.g. a read-only data directory: the grid in memory
+    std::cout << "in Comsol Fields: no tiled field map, uniform grid in memory instead" << std::endl;
+    KDTreeMap kdmap(this);
+    return new GridMap(&kdmap, step);
+  }
+  if (method==lazy_grid) { // tiles sampled at first use from the shared source map
+    double xmin, xmax, ymin, ymax; // as KDTreeMap::bounds(), the source may be the mesh
+    node_bounds(store->x, store->y, xmin, xmax, ymin, ymax);
+    double st = (step>0.0) ? step : node_spacing(store->x, store->y);
+    return new LazyGridMap(shared_map(gm, lazy_source(method), 0.0), xmin, xmax, ymin, ymax, st);
+  }
+  KDTreeMap* kdmap = new KDTreeMap(this);
+  if (method==uniform_grid && storage!=storage_double) { // float or 16 bit nodes
+    double xmin, xmax, ymin, ymax;
+    kdmap->bounds(xmin, xmax, ymin, ymax);
+    CompactGridMap* grid = new CompactGridMap(kdmap, xmin, xmax, ymin, ymax,
+					      (step>0.0) ? step : kdmap->spacing(), storage);
+    delete kdmap;
+    return grid;
+  }
+  if (method==uniform_grid) { // resample once, the tree is not needed after
+    GridMap* grid = new GridMap(kdmap, step);
+    delete kdmap;
+    return grid;
+  }
+  return kdmap; // holds on to the nodes
+}
+
+
+void ComsolFields::setFieldMap(int method, double step, std::shared_ptr<FieldMap> map) {
+  std::lock_guard<std::mutex> lock(maplock);
+  map_entry_t entry;
+  entry.method = method;
+  entry.step = step;
+  entry.storage = (method==uniform_grid) ? storage : storage_double;
+  entry.source = lazy_source(method);
+  entry.map = map;
+  maps.insert(maps.begin(), entry); // found before any built one
+}
 
+
+void ComsolFields::releaseNodes() {
+  std::lock_guard<std::mutex> lock(maplock);
+  store.reset(); // KD-tree maps still hold theirs
+  if (fcache) delete fcache;
+  fcache = 0;
+}
+
+
+Fields::Fields(ComsolFields* fem, GeometryModel* g, int method, double step) {
+  gm = g; // have access to geometry model
+  map = fem->fieldMap(g, method, step); // one for all Electrodes
 }
 
 
 
 
-Point3 Fields::getDriftField(Point3 p, bool& analytic) {
-  Point3 triplet = getFieldValue(p, analytic);
+Point3 Fields::getDriftField(const Point3& p, bool& analytic) {
+  double safety = 0.0; // always ask the geometry
+  Point3 triplet = getFieldValue(p, analytic, safety);
   return triplet;
 }
 
 
+Point3 Fields::getDriftField(const Point3& p, bool& analytic, double& safety) {
+  Point3 triplet = getFieldValue(p, analytic, safety);
+  return triplet;
+}
+
 
-Point3 Fields::getFieldValue(Point3 p, bool& analytic) {
+
+Point3 Fields::getFieldValue(const Point3& p, bool& analytic, double& safety) {
 
   // common routine to ask for field value
 
@@ -120,47 +281,25 @@ Point3 Fields::getFieldValue(Point3 p, bool& analytic) {
   double yv = p.yc();
   double zv = p.zc();
 
-  int value = gm->whereami(xv,yv,zv);
+  int wire; // hit or closest wire, not needed here
+  int value = 1; // still well inside the drift region
+  if (!gm->useLattice()) {
+    value = gm->whereami(xv,yv,zv); // TGeo, navigator per thread
+    safety = 0.0; // no distance map
+  }
+  else if (safety <= 0.0) {
+    value = gm->region(xv,yv,zv,wire); // as whereami, without TGeo
+    safety = (value==1) ? gm->distance(xv,yv,zv,wire) : 0.0;
+  }
   //  std::cout << "in Fields::answer to whereami: " << value << std::endl;
   Point3 triplet;
   
   if (value==1) { // comsol region
-    double point[2];
-    double dist[8]; // check on nearest 8 neighbours in grid
-    int indx[8];
-    
-    TVector3 fieldvec;
-    TVector3 sumvec;
-    std::vector<TVector3> nnvec;
-    
-    double dsum = 0.0;
-    point[0] = xv;  // relative to origin x
-    point[1] = yv;  // relative to origin y
-
-    //    std::cout << "in Fields: point coordinates " << xv << " " << yv << " " << zv << std::endl;
-        
-    coordinates->FindNearestNeighbors(point,8,indx,dist);
-    for (int j=0;j<8;j++) {
-      fieldvec.SetXYZ(alldx[indx[j]], alldy[indx[j]], 0.0);
-      //      std::cout << "in Fields: nearest coords: " << allx[indx[j]] << " " << ally[indx[j]] << std::endl;
-      //      std::cout << "in Fields: Drift field value: " << alldx[indx[j]] << " " << alldy[indx[j]] << std::endl;
-      nnvec.push_back(fieldvec);
-      dsum += dist[j];
-    }
-
-    double denom = 0.0;
-    for (int j=0;j<8;j++) denom += (1.0-dist[j]/dsum);
-    
-    sumvec.SetXYZ(0.,0.,0.);
-    for (int j=0;j<8;j++) {
-      fieldvec = nnvec.at(j)*((1.0-dist[j]/dsum)/denom);
-      sumvec += fieldvec;
-    }
-    // getting the proportions right between x and y field components 
-    triplet.Set(sumvec.X(),sumvec.Y(),sumvec.Z());
+    double ex, ey;
+    map->field(xv, yv, ex, ey);
+    triplet.Set(ex,ey,0.0);
     //    std::cout << "in Fields: point coordinates " << xv << " " << yv << " " << zv << std::endl;
-    //    std::cout << "in Fields: average field value " << sumvec.X() << " " << sumvec.Y() << " " << sumvec.Z() << std::endl;
-    
+    //    std::cout << "in Fields: field value " << ex << " " << ey << std::endl;
   }
   else { // any other region than Comsol like a wire or world.
     // outside anything relevant, stop transport.
@@ -3,13 +3,71 @@
 
 // standard includes
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <thread>
 
 // ROOT includes
 #include "TGeoVolume.h"
+#include "TGeoMatrix.h"
+#include "TGeoTube.h"
 #include "TString.h"
 #include "TObjArray.h"
 
 
+// Navigators a model hands out. Shared with the threads holding one,
+// they remove their navigator at thread exit only while alive.
+struct geo_navigators {
+  std::mutex mtx;
+  TGeoManager* geom;
+  bool alive;
+  unsigned int maxthreads; // TGeo thread slots, besides the importing thread
+  unsigned int workers; // threads holding a navigator of their own
+};
+
+
+// threads holding a navigator of their own, over all models
+static std::mutex tgeo_mtx;
+static unsigned int tgeo_workers = 0;
+
+static void release_worker() {
+  // TGeo never reuses a thread id and the id map is global; with
+  // the last worker of any model gone the ids start again from 0,
+  // else every new pool would use up slots
+  std::lock_guard<std::mutex> lck (tgeo_mtx);
+  if (--tgeo_workers==0) TGeoManager::ClearThreadsMap();
+}
+
+
+// navigators of the calling thread, one per geometry model
+struct thread_navigators {
+  struct entry {
+    std::shared_ptr<geo_navigators> owner;
+    TGeoNavigator* nav;
+    bool own; // made by us, not the manager's default one
+  };
+  std::vector<entry> entries;
+  unsigned int orphans = 0; // own navigators gone with their model
+
+  ~thread_navigators() { // thread exit, e.g. at pool shutdown
+    for (unsigned int i=0;i<orphans;i++) release_worker();
+    for (entry& e : entries) {
+      if (!e.own) continue;
+      {
+	std::lock_guard<std::mutex> lck (e.owner->mtx);
+	if (e.owner->alive) {
+	  e.owner->geom->RemoveNavigator(e.nav);
+	  e.owner->workers--;
+	}
+      }
+      release_worker();
+    }
+  }
+};
+static thread_local thread_navigators mynavs;
+
+
 //****************
 // Geometry Model
 //****************
@@ -18,10 +76,25 @@ GeometryModel::GeometryModel(const char* filename) {
 
   // import geometry from file
   // closes geometry but ID's can be different to initial building
+  for (int i=0;i<6;i++) comsolbox[i] = 0.0;
+  lattice = true;
+  geom = 0;
+  navs = std::make_shared<geo_navigators>();
+  navs->geom = 0;
+  navs->alive = true;
+  navs->maxthreads = 0;
+  navs->workers = 0;
+  hashstep = 1.0;
+  nhx = nhy = 0;
+  diststep = 1.0;
+  ndx = ndy = 0;
   TGeoManager* g = new TGeoManager("dummy","");
   try {
     geom = g->Import(filename);
     fill_wires(); // only constructed when geometry is known from file
+    navs->geom = geom;
+    // navigation per thread, for a pool on all hardware threads
+    setThreads(std::max(1u, std::thread::hardware_concurrency()));
   } catch (const std::exception& e) {
     std::cout << "Exception: " << e.what() << std::endl;
     std::cout << "Could not import " << std::endl;
@@ -33,35 +106,235 @@ GeometryModel::GeometryModel(const char* filename) {
 // default Destructor
 GeometryModel::~GeometryModel() {
   wires.clear();
+  {
+    std::lock_guard<std::mutex> lck (navs->mtx);
+    navs->alive = false; // the manager deletes all navigators
+  }
   if (geom) delete geom;
 }
 
 
 
+void GeometryModel::setThreads(unsigned int n) {
+  // TGeo keeps per-thread data for a fixed number of threads;
+  // resized only while no worker navigates
+  std::lock_guard<std::mutex> lck (navs->mtx);
+  if (!geom || n<=navs->maxthreads) return;
+  if (navs->workers>0) {
+    std::cout << "Error: geometry thread slots can not grow while "
+	      << navs->workers << " threads navigate" << std::endl;
+    return;
+  }
+  geom->SetMaxThreads(n);
+  navs->maxthreads = n;
+}
+
+
+unsigned int GeometryModel::getThreads() {
+  std::lock_guard<std::mutex> lck (navs->mtx);
+  return navs->maxthreads;
+}
+
+
 void GeometryModel::fill_wires() {
   TGeoVolume* vol = geom->FindVolumeFast("Comsol"); // hard-wired region name
   TObjArray* lon = vol->GetNodes(); // should all be in comsol region
   
   TString name;
   
+  // placement of the Comsol box in the world
+  TGeoMatrix* place = 0;
+  TObjArray* top = geom->GetTopVolume()->GetNodes();
+  for (int n=0;n<top->GetEntries();n++) {
+    TGeoNode* nd = (TGeoNode*)top->At(n);
+    if (nd->GetVolume()==vol) place = nd->GetMatrix();
+  }
+  double origin[3] = {0.0, 0.0, 0.0};
+  double centre[3] = {0.0, 0.0, 0.0};
+  if (place) place->LocalToMaster(origin, centre);
+  TGeoBBox* box = (TGeoBBox*)vol->GetShape();
+  comsolbox[0] = centre[0] - box->GetDX();
+  comsolbox[1] = centre[0] + box->GetDX();
+  comsolbox[2] = centre[1] - box->GetDY();
+  comsolbox[3] = centre[1] + box->GetDY();
+  comsolbox[4] = centre[2] - box->GetDZ();
+  comsolbox[5] = centre[2] + box->GetDZ();
+
+  double local[3];
+  double world[3];
   for (int n=0;n<lon->GetEntries();n++) {
     name = lon->At(n)->GetName();
-    if (name.Contains("Wire"))  // hard-wired wire name
-      wires.push_back((TGeoNode*)lon->At(n));
+    if (name.Contains("Wire")) { // hard-wired wire name
+      TGeoNode* nd = (TGeoNode*)lon->At(n);
+      wires.push_back(nd);
+      nd->GetMatrix()->LocalToMaster(origin, local); // in Comsol
+      if (place) place->LocalToMaster(local, world);
+      else {world[0] = local[0]; world[1] = local[1];}
+      wire_t w;
+      w.x = world[0];
+      w.y = world[1];
+      w.r = ((TGeoTube*)nd->GetVolume()->GetShape())->GetRmax();
+      wirelist.push_back(w);
+    }
   }
   std::cout << "Geometry model; got "<< wires.size() << " wires" << std::endl;
+  make_hash();
+  make_distance();
+}
+
+
+void GeometryModel::make_hash() {
+  // cells of about half the wire pitch, a cell sees one or two wires
+  hashstep = 0.5; // [cm]
+  nhx = (int)((comsolbox[1] - comsolbox[0]) / hashstep) + 1;
+  nhy = (int)((comsolbox[3] - comsolbox[2]) / hashstep) + 1;
+
+  std::vector<std::vector<int> > cells(nhx * nhy);
+  for (unsigned int w=0;w<wirelist.size();w++) {
+    const wire_t& wr = wirelist[w];
+    // every cell the disc overlaps, bounding box is enough
+    int ilow = (int)((wr.x - wr.r - comsolbox[0]) / hashstep);
+    int ihigh = (int)((wr.x + wr.r - comsolbox[0]) / hashstep);
+    int jlow = (int)((wr.y - wr.r - comsolbox[2]) / hashstep);
+    int jhigh = (int)((wr.y + wr.r - comsolbox[2]) / hashstep);
+    for (int j=std::max(jlow,0);j<=std::min(jhigh,nhy-1);j++)
+      for (int i=std::max(ilow,0);i<=std::min(ihigh,nhx-1);i++)
+	cells[j*nhx + i].push_back(w);
+  }
+  cellstart.assign(1, 0);
+  cellwires.clear();
+  for (std::vector<int>& c : cells) {
+    cellwires.insert(cellwires.end(), c.begin(), c.end());
+    cellstart.push_back(cellwires.size());
+  }
+}
+
+
+
+void GeometryModel::comsolBounds(double& xmin, double& xmax, double& ymin, double& ymax) {
+  xmin = comsolbox[0];
+  xmax = comsolbox[1];
+  ymin = comsolbox[2];
+  ymax = comsolbox[3];
+}
+
+
 
+void GeometryModel::make_distance() {
+  // Signed distance at the cell centre to the box walls and the
+  // nearest wire surface, less half the cell diagonal, is a lower
+  // bound anywhere in the cell (distance changes no faster than 1:1).
+  diststep = 0.05; // [cm]
+  ndx = (int)((comsolbox[1] - comsolbox[0]) / diststep) + 1;
+  ndy = (int)((comsolbox[3] - comsolbox[2]) / diststep) + 1;
+  double halfdiag = 0.5 * std::sqrt(2.0) * diststep;
+
+  safedist.assign(ndx * ndy, 0.0);
+  nearest.assign(ndx * ndy, -1);
+  for (int j=0;j<ndy;j++)
+    for (int i=0;i<ndx;i++) {
+      double x = comsolbox[0] + (i+0.5) * diststep;
+      double y = comsolbox[2] + (j+0.5) * diststep;
+      double d = std::min(std::min(x - comsolbox[0], comsolbox[1] - x),
+			  std::min(y - comsolbox[2], comsolbox[3] - y));
+      int best = -1;
+      double dwire = 1.e30;
+      for (unsigned int w=0;w<wirelist.size();w++) {
+	const wire_t& wr = wirelist[w];
+	double dw = std::sqrt((x-wr.x)*(x-wr.x) + (y-wr.y)*(y-wr.y)) - wr.r;
+	if (dw < dwire) {
+	  dwire = dw;
+	  best = w;
+	}
+      }
+      safedist[j*ndx + i] = std::min(d, dwire) - halfdiag;
+      nearest[j*ndx + i] = best;
+    }
+}
+
+
+double GeometryModel::distance(double xv, double yv, double zv, int& wire) const {
+  wire = -1;
+  double dz = std::min(zv - comsolbox[4], comsolbox[5] - zv);
+  if (ndx==0 || xv < comsolbox[0] || xv > comsolbox[1] ||
+      yv < comsolbox[2] || yv > comsolbox[3] || dz < 0.0)
+    return -1.0; // outside, no safe distance
+
+  int i = std::min((int)((xv - comsolbox[0]) / diststep), ndx-1);
+  int j = std::min((int)((yv - comsolbox[2]) / diststep), ndy-1);
+  wire = nearest[j*ndx + i];
+  return std::min(safedist[j*ndx + i], dz);
+}
+
+
+int GeometryModel::region(double xv, double yv, double zv, int& wire) const {
+  // inclusive boundaries, as TGeoBBox and TGeoTube Contains()
+  wire = -1;
+  if (nhx==0 || xv < comsolbox[0] || xv > comsolbox[1] ||
+      yv < comsolbox[2] || yv > comsolbox[3] ||
+      zv < comsolbox[4] || zv > comsolbox[5])
+    return -1; // out, stop transport
+
+  int i = std::min((int)((xv - comsolbox[0]) / hashstep), nhx-1);
+  int j = std::min((int)((yv - comsolbox[2]) / hashstep), nhy-1);
+  int cell = j*nhx + i;
+  for (int k=cellstart[cell];k<cellstart[cell+1];k++) {
+    const wire_t& wr = wirelist[cellwires[k]];
+    double dx = xv - wr.x;
+    double dy = yv - wr.y;
+    if (dx*dx + dy*dy <= wr.r*wr.r) {
+      wire = cellwires[k];
+      return -1; // stop on a wire
+    }
+  }
+  return 1; // drifting region, field map
+}
+
+
+
+TGeoNavigator* GeometryModel::navigator() {
+  for (thread_navigators::entry& e : mynavs.entries)
+    if (e.owner==navs) return e.nav;
+
+  // first query on this thread, forget navigators of dead models
+  for (unsigned int i=0;i<mynavs.entries.size();) {
+    bool dead;
+    {
+      std::lock_guard<std::mutex> lck (mynavs.entries[i].owner->mtx);
+      dead = !mynavs.entries[i].owner->alive;
+    }
+    if (!dead) {
+      i++;
+      continue;
+    }
+    if (mynavs.entries[i].own) mynavs.orphans++; // thread id kept till exit
+    mynavs.entries.erase(mynavs.entries.begin()+i);
+  }
+
+  std::lock_guard<std::mutex> lck (navs->mtx);
+  thread_navigators::entry e;
+  e.owner = navs;
+  e.nav = geom->GetCurrentNavigator(); // the importing thread has one
+  e.own = false;
+  if (!e.nav) {
+    e.nav = geom->AddNavigator();
+    e.own = true;
+    navs->workers++;
+    std::lock_guard<std::mutex> glck (tgeo_mtx);
+    tgeo_workers++;
+  }
+  mynavs.entries.push_back(e);
+  return e.nav;
 }
 
 
 
 int GeometryModel::whereami(double xv, double yv, double zv) {
-  // Talk to geometry
-  geom->SetCurrentPoint(xv,yv,zv);
-  TGeoNode* nd = geom->FindNode();
-  TGeoVolume* vol = nd->GetVolume();
-  
-  TString region(vol->GetName()); // changed from GetNumber()
+  // Talk to geometry, own navigator per thread, no lock
+  TGeoNavigator* nav = navigator();
+  nav->SetCurrentPoint(xv,yv,zv);
+  TGeoNode* nd = nav->FindNode();
+  TString region(nd->GetVolume()->GetName()); // changed from GetNumber()
   //  std::cout << "Geometry model: region = " << region << std::endl;
   //  std::cout << "Geometry model: coords: " << xv << " " << yv << " " << zv << std::endl;
 
@@ -0,0 +1,78 @@
+#include <cstdio>
+
+// POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// us
+#include "mappedfile.hh"
+
+
+bool file_stamp(std::string fname, uint64_t& size, int64_t& mtime) {
+  struct stat st;
+  if (stat(fname.c_str(), &st) != 0) return false;
+  size = st.st_size;
+  mtime = st.st_mtime;
+  return true;
+}
+
+
+bool file_writable(std::string fname) {
+  // a temporary is made next to fname and renamed
+  size_t slash = fname.rfind('/');
+  std::string dir = (slash==std::string::npos) ? "." : fname.substr(0, slash+1);
+  return access(dir.c_str(), W_OK) == 0;
+}
+
+
+bool MappedFile::map(std::string fname, size_t minimum) {
+  unmap();
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) return false; // not made yet
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)minimum || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  length = st.st_size;
+  base = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping stays
+  if (base == MAP_FAILED) {
+    base = 0;
+    length = 0;
+    return false;
+  }
+  return true;
+}
+
+
+void MappedFile::unmap() {
+  if (base) munmap(base, length);
+  base = 0;
+  length = 0;
+}
+
+
+FileWriter::FileWriter(std::string fname) {
+  name = fname;
+  tmpname = fname + ".tmp" + std::to_string(getpid());
+  done = false;
+  out.open(tmpname.c_str(), std::ios::binary);
+}
+
+
+FileWriter::~FileWriter() {
+  if (done) return;
+  if (out.is_open()) out.close();
+  std::remove(tmpname.c_str());
+}
+
+
+bool FileWriter::commit() {
+  out.close();
+  if (!out || std::rename(tmpname.c_str(), name.c_str()) != 0) return false; // destructor cleans up
+  done = true;
+  return true;
+}
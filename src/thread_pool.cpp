@@ -5,7 +5,7 @@ using namespace std;
 /**
  * Constructs a thread pool with `num_threads` threads and an empty work queue.
  */
-thread_pool::thread_pool(unsigned int num_threads) : num_threads(num_threads){
+thread_pool::thread_pool(unsigned int num_threads) : num_threads(num_threads), ring(1024){
 	task_mutex.lock();
 	init_threads();
 	task_mutex.unlock();
@@ -17,6 +17,7 @@ thread_pool::thread_pool(unsigned int num_threads) : num_threads(num_threads){
 thread_pool::~thread_pool(){
 	task_mutex.lock();
 	join = true;
+	task_cv.notify_all();
 	task_mutex.unlock();
 	for(auto i = threads.begin();i != threads.end();i++)
 		i->join();
@@ -32,39 +33,112 @@ void thread_pool::init_threads(){
 	}
 }
 
+/**
+ * Appends a task to the ring, called with the queue locked. A full ring
+ * doubles, so pushes do not allocate once the queue has seen its
+ * deepest backlog.
+ */
+void thread_pool::push(task_base* t){
+	if(count == ring.size()){
+		std::vector<task_base*> bigger(2*ring.size());
+		for(std::size_t i = 0;i < count;i++)
+			bigger[i] = ring[(head + i) & (ring.size() - 1)];
+		ring.swap(bigger);
+		head = 0;
+	}
+	ring[(head + count) & (ring.size() - 1)] = t;
+	count++;
+}
+
+/**
+ * Takes the oldest task off the ring, called with the queue locked.
+ */
+thread_pool::task_base* thread_pool::pop(){
+	task_base* t = ring[head];
+	head = (head + 1) & (ring.size() - 1);
+	count--;
+	return t;
+}
+
+/**
+ * Returns the idle counters accumulated since construction or the last
+ * reset_stats().
+ */
+thread_pool::statistics thread_pool::stats() const{
+	statistics st;
+	st.tasks = ntasks.load();
+	st.parks = nparks.load();
+	st.wakeups = nwakeups.load();
+	st.idle_time = 1.e-9 * idle_ns.load();
+	return st;
+}
+
+/**
+ * Zeroes the idle counters, e.g. between two transport runs.
+ */
+void thread_pool::reset_stats(){
+	ntasks = 0;
+	nparks = 0;
+	nwakeups = 0;
+	idle_ns = 0;
+}
+
 /**
  * Manages thread execution. This is the function that threads actually run.
- * It pulls a task out of the queue and executes it.
+ * It pulls a task out of the queue and runs it on this thread. An idle
+ * worker polls the queue for spin_count rounds and then parks on the
+ * condition variable until a task arrives or the pool joins.
  */
 void thread_pool::thread_func(){
+	typedef std::chrono::steady_clock clock;
+
 	for(;;){
+		clock::time_point idle_start;
+		bool idle = (queued.load(std::memory_order_acquire) == 0);
+
+		// Spin for a short while, the next task is often just about to
+		// be pushed.
+		if(idle){
+			idle_start = clock::now();
+			unsigned int nspin = spin_count.load(std::memory_order_relaxed);
+			for(unsigned int s = 0;s < nspin && queued.load(std::memory_order_acquire) == 0;s++)
+				this_thread::yield();
+		}
+
 		// Lock the queue.
-		task_mutex.lock();
-
-		// If there's nothing to do and we're not ready to join, just
-		// yield.
-		if(tasks.empty() && !join){
-			task_mutex.unlock();
-			this_thread::yield();
-			continue;
+		std::unique_lock<std::mutex> lock(task_mutex);
+
+		// Still nothing to do and not ready to join: park.
+		if(count == 0 && !join){
+			sleeping++;
+			nparks++;
+			while(count == 0 && !join){
+				task_cv.wait(lock);
+				nwakeups++;
+			}
+			sleeping--;
 		}
+
+		if(idle)
+			idle_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - idle_start).count();
+
 		// If there's tasks waiting, do one.
-		else if(!tasks.empty()){
+		if(count > 0){
 			// Get a task.
-			auto f = std::move(tasks.front());
-			tasks.pop_front();
-			
+			task_base* t = pop();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+
 			// Unlock the queue.
-			task_mutex.unlock();
-			
-			// Execute the async function.
-			f.get();
+			lock.unlock();
+
+			// Execute the task, the result goes to its future.
+			t->run();
+			t->release();
+			ntasks++;
 		}
 		// If there's no tasks and we're ready to join, then exit the
 		// function (effectively joining).
-		else if(join){
-			task_mutex.unlock();
+		else
 			return;
-		}
 	}
 }
@@ -3,6 +3,9 @@
 
 // general
 #include "math.h"
+#include <fstream>
+#include <string>
+#include <cstdlib>
 
 //************************
 // Euclid member functions
@@ -143,3 +146,15 @@ bool BBox::IsInside(Point3 p) {
 }
 
 
+//*******
+// Process
+//*******
+double peak_memory() {
+  // high water mark of the resident set, Linux only
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, 6, "VmHWM:")==0)
+      return std::atof(line.data()+6) / 1024.0; // [kB] -> [MB]
+  return 0.0;
+}
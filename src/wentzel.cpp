@@ -0,0 +1,84 @@
+// us
+#include "wentzel.hh"
+
+// standard includes
+#include <cmath>
+
+
+//****************
+// Wentzel sampler
+//****************
+WentzelTable::WentzelTable(int ne, int nu, double emx) {
+  nenergy = ne;
+  nuniform = nu;
+  emax = emx;
+  escale = (nenergy-1) / std::sqrt(emax);
+
+  // grid uniform in sqrt(energy), xi depends on it only
+  costable.resize(nenergy * nuniform);
+  for (int i=0;i<nenergy;i++) {
+    double sqre = i / escale;
+    for (int j=0;j<nuniform;j++)
+      costable[i*nuniform + j] = analytic(sqre*sqre, (double)j / (nuniform-1));
+  }
+}
+
+
+double WentzelTable::xi(double energy) {
+  // fit parameters for helium, energy in [eV]
+  const double p1 = 2.45;
+  const double p2 = 2.82;
+  const double p3 = 11.98;
+  const double p4 = 5.11;
+  const double p5 = 64.01;
+  double sqre = std::sqrt(energy);
+  return 1.0 + (p1 * sqre - p2*p2 - p3) / ((sqre - p2)*(sqre - p2) + p3) - p1*sqre / ((sqre - p4)*(sqre - p4) + p5);
+}
+
+
+double WentzelTable::analytic(double energy, double r) {
+  // inverse of the cumulative angular distribution
+  double x = xi(energy);
+  double nom = 2*r * (1.0 - x);
+  double denom = 1.0 + x * (1.0 - 2*r);
+  return 1.0 - nom / denom;
+}
+
+
+void WentzelTable::sample(double energy, double r, double& costh, double& sinth) const {
+  if (energy >= emax) // rare, outside the table
+    costh = analytic(energy, r);
+  else {
+    // bilinear interpolation
+    double fe = std::sqrt(energy) * escale;
+    double fu = r * (nuniform-1);
+    int ie = (int)fe;
+    int iu = (int)fu;
+    if (ie > nenergy-2) ie = nenergy-2;
+    if (iu > nuniform-2) iu = nuniform-2;
+    fe -= ie;
+    fu -= iu;
+    const double* c0 = &costable[ie*nuniform + iu];
+    const double* c1 = c0 + nuniform;
+    costh = (1.0-fe) * ((1.0-fu)*c0[0] + fu*c0[1]) + fe * ((1.0-fu)*c1[0] + fu*c1[1]);
+  }
+  // sin from cos keeps rotations length preserving
+  double s2 = 1.0 - costh*costh;
+  sinth = (s2 > 0.0) ? std::sqrt(s2) : 0.0;
+}
+
+
+double WentzelTable::maxError(int ntest) const {
+  double worst = 0.0;
+  double costh, sinth;
+  for (int i=0;i<ntest;i++) {
+    double energy = emax * (i + 0.5) / ntest;
+    for (int j=0;j<=ntest;j++) {
+      double r = (double)j / ntest;
+      sample(energy, r, costh, sinth);
+      double d = std::fabs(costh - analytic(energy, r));
+      if (d > worst) worst = d;
+    }
+  }
+  return worst;
+}
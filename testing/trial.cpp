@@ -1,9 +1,24 @@
 #include "catch.hpp"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <string>
 
 // us
 #include "ctransport.hh"
 #include "fields.hh"
 #include "geomodel.hh"
+#include "thread_pool.hpp"
+#include "philox.hh"
+#include "wentzel.hh"
+#include "fieldmap.hh"
+#include "fieldcache.hh"
+#include "cscache.hh"
+
+// ROOT
+#include "TMath.h"
 
 
 int check_geometry(){
@@ -27,7 +42,26 @@ unsigned int check_fields(){
   // reach from testing directory
   ComsolFields* fem = new ComsolFields("../data/sntracker_driftField.root");
   fem->read_fields();
-  return fem->positions().size(); // should be currently 258462
+  return fem->nodes()->x.size(); // should be currently 258462
+}
+
+
+int check_sharedmap(){
+  // two electrodes, one map; it outlives the released nodes
+  const char* gfname = "../data/trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname);
+  ComsolFields* fem = new ComsolFields("../data/sntracker_driftField.root");
+  fem->read_fields();
+  std::shared_ptr<FieldMap> first = fem->fieldMap(gmodel, kdtree_idw, 0.0);
+  std::shared_ptr<FieldMap> second = fem->fieldMap(gmodel, kdtree_idw, 0.0);
+  if (first!=second) return 1;
+  double ex, ey;
+  first->field(3.5, -2.9, ex, ey);
+  fem->releaseNodes();
+  if (fem->nodes()) return 2;
+  double fx, fy;
+  second->field(3.5, -2.9, fx, fy);
+  return (fx==ex && fy==ey) ? 0 : 3;
 }
 
 
@@ -39,6 +73,610 @@ double check_readcs(){
 }
 
 
+// table lookups of the transport, for the checks below
+class CtransportProbe : public Ctransport {
+ public:
+  CtransportProbe(std::string fname) : Ctransport(fname, 0) {}
+  using Ctransport::energybins;
+  using Ctransport::nprocess;
+  using Ctransport::cstable;
+  using Ctransport::findBin;
+  using Ctransport::majorant_rate;
+  using Ctransport::time_update;
+  using Ctransport::collision_process;
+};
+
+
+int check_findbin(){
+  // grid lookup against the plain binary search: bin edges,
+  // either side of them, first and last bin, out of range
+  CtransportProbe ctr("../data/trackergasCS.root");
+  const std::vector<double>& e = ctr.energybins;
+  int last = (int)e.size()-1;
+  std::vector<double> probes;
+  for (unsigned int i=0;i<e.size();i++) {
+    probes.push_back(e[i]);
+    probes.push_back(std::nextafter(e[i], -1.0));
+    probes.push_back(std::nextafter(e[i], 100.0));
+    if (i>0) probes.push_back(0.5*(e[i-1] + e[i]));
+  }
+  Philox rng(6, 0, 0, 0);
+  for (int n=0;n<100000;n++) probes.push_back(42.0*rng.Rndm() - 1.0);
+  probes.push_back(0.0);
+  probes.push_back(-1.e-300);
+  probes.push_back(-5.0);
+  probes.push_back(std::nextafter(40.0, 0.0));
+  probes.push_back(40.0);
+  probes.push_back(1.e6);
+  int bad = 0;
+  for (double en : probes) {
+    int expect;
+    if (en>=40.0) expect = last; // final entry
+    else expect = std::lower_bound(e.begin(), e.end(), std::max(en, 0.0)) - e.begin();
+    if (ctr.findBin(en)!=expect) bad++;
+  }
+  if (ctr.findBin(e[0])!=0 || ctr.findBin(-1.0)!=0) bad++; // first bin
+  return bad;
+}
+
+
+int check_majorant(){
+  // the null collision bound holds on a dense energy scan
+  // and at every bin edge, where the rate jumps
+  CtransportProbe ctr("../data/trackergasCS.root");
+  double c = 2.99792458e8; // [m/s]
+  double mass_eV = 0.511e6;
+  std::vector<double> probes(ctr.energybins);
+  for (int n=0;n<=400000;n++) probes.push_back(1.e-4*n); // [eV] up to 40
+  int bad = 0;
+  for (double en : probes) {
+    if (en>40.0) continue; // constant kmax beyond the tables
+    double kv;
+    ctr.collision_process(en, c*std::sqrt(2.0*en/mass_eV), 1.e300, kv);
+    if (kv > ctr.majorant_rate(en)) bad++;
+  }
+  return bad;
+}
+
+
+double check_freeflight(){
+  // mean time to a real collision at fixed energy: null collisions
+  // under the majorant against direct sampling at the true rate
+  CtransportProbe ctr("../data/trackergasCS.root");
+  double c = 2.99792458e8; // [m/s]
+  double mass_eV = 0.511e6;
+  double density = 2.5e25; // [1/m^3]
+  double energies[4] = {0.05, 1.0, 8.0, 25.0}; // [eV]
+  Philox rng(8, 0, 0, 0);
+  int n = 100000;
+  double maxdev = 0.0;
+  for (double en : energies) {
+    double speed = c*std::sqrt(2.0*en/mass_eV);
+    double kv;
+    ctr.collision_process(en, speed, 1.e300, kv);
+    double kmaj = ctr.majorant_rate(en);
+    double tnull = 0.0;
+    double tdirect = 0.0;
+    for (int i=0;i<n;i++) {
+      double k;
+      do tnull += ctr.time_update(1.0/(density*kmaj), rng);
+      while (ctr.collision_process(en, speed, rng.Rndm()*kmaj, k) < 0);
+      tdirect += ctr.time_update(1.0/(density*kv), rng);
+    }
+    maxdev = std::max(maxdev, std::fabs(tnull - tdirect) / tdirect);
+  }
+  return maxdev; // statistics only, 0.3% per energy
+}
+
+
+int check_channels(){
+  // one draw under the majorant: real collisions pick each
+  // (gas, process) in proportion to its cross section
+  CtransportProbe ctr("../data/trackergasCS.root");
+  ctr.setMixture(0.85, 0.1, 0.05); // all three gases in play
+  double c = 2.99792458e8; // [m/s]
+  double mass_eV = 0.511e6;
+  double energies[3] = {1.0, 12.0, 30.0}; // [eV]
+  Philox rng(9, 0, 0, 0);
+  int n = 1000000;
+  int bad = 0;
+  for (double en : energies) {
+    double speed = c*std::sqrt(2.0*en/mass_eV);
+    double kmaj = ctr.majorant_rate(en);
+    std::vector<int> counts(ctr.nprocess, 0);
+    int nreal = 0;
+    for (int i=0;i<n;i++) {
+      double kv;
+      int process = ctr.collision_process(en, speed, rng.Rndm()*kmaj, kv);
+      if (process<0) continue;
+      counts[process]++;
+      nreal++;
+    }
+    int bin = std::min(ctr.findBin(en), (int)ctr.energybins.size()-1);
+    const double* cumulative = &ctr.cstable[bin*ctr.nprocess];
+    double total = cumulative[ctr.nprocess-1];
+    for (int p=0;p<ctr.nprocess;p++) {
+      double frac = (cumulative[p] - ((p>0) ? cumulative[p-1] : 0.0)) / total;
+      double sigma = std::sqrt(frac*(1.0-frac)/nreal);
+      if (std::fabs((double)counts[p]/nreal - frac) > 5.0*sigma + 1.e-12) bad++;
+    }
+  }
+  return bad;
+}
+
+
+int check_cstable(){
+  // MagBoltz text layout to a standalone table and back
+  const char* text = "cstable_test.txt";
+  const char* cname = "cstable_test.csbin";
+  {
+    std::ofstream out(text);
+    for (int g=0;g<3;g++) {
+      out << "# gas " << g << std::endl;
+      for (int i=0;i<10;i++)
+	out << 0.5*i << "  " << (g+1)*1.e-16 << "  " << i*1.e-17 << std::endl;
+    }
+  }
+  cs_table_t cs;
+  if (!read_cs_magboltz(text, cs) || cs.energy.size()!=10) return 1;
+  if (!CSCache::write(cname, "", cs)) return 2;
+  int bad = 0;
+  CSCache table(cname, "");
+  if (!table.valid() || table.bins()!=10) return 3;
+  for (int i=0;i<10;i++) {
+    if (table.energy()[i]!=0.5*i) bad++;
+    if (std::fabs(table.elastic(2)[i] - 3.e-20) > 1.e-30) bad++; // [m^2]
+    if (std::fabs(table.inelastic(1)[i] - i*1.e-21) > 1.e-30) bad++;
+  }
+  std::remove(text);
+  std::remove(cname);
+  return bad;
+}
+
+
+int check_pool(){
+  thread_pool* pool = new thread_pool(4);
+  std::vector<thread_pool::future<int> > results;
+  for (int i=0;i<1000;i++)
+    results.push_back(pool->async(std::function<int(int)>([](int n) {return n;}), i));
+  int sum = 0;
+  for (thread_pool::future<int>& r : results) sum += r.get();
+  delete pool;
+  return sum; // should be 999*1000/2
+}
+
+
+int check_threadcount(){
+  // same seed and run on 1 and 4 pool threads: the same
+  // drift times and end points, bit for bit, in stream order
+  const char* gfname = "../data/trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname);
+  ComsolFields* fem = new ComsolFields("../data/sntracker_driftField.root");
+  fem->read_fields();
+  Electrode* anode = new Electrode(fem, gmodel);
+  Ctransport* ctr = new Ctransport("../data/trackergasCS.root", 7);
+  charge_t hit;
+  hit.location = Point3(3.5, -2.9, 0.0);
+  hit.charge = -1;
+  std::list<charge_t> hits;
+  for (int i=0;i<8;i++) {
+    hit.chargeID = i;
+    hits.push_back(hit);
+  }
+  ctr->setThreads(1);
+  ctr->setRun(3);
+  ctr->ctransport(anode, hits);
+  std::vector<double> t1 = ctr->getDriftTimes();
+  std::vector<Point3> p1 = ctr->getLocations();
+  ctr->setThreads(4);
+  ctr->setRun(3);
+  ctr->ctransport(anode, hits);
+  std::vector<double> tn = ctr->getDriftTimes();
+  std::vector<Point3> pn = ctr->getLocations();
+  delete ctr;
+  delete anode;
+  delete fem;
+  delete gmodel;
+  if (t1.empty() || t1.size()!=tn.size() || p1.size()!=pn.size()) return -1;
+  int bad = 0;
+  for (unsigned int i=0;i<t1.size();i++) {
+    if (t1[i]!=tn[i]) bad++;
+    if (p1[i].xc()!=pn[i].xc() || p1[i].yc()!=pn[i].yc() || p1[i].zc()!=pn[i].zc()) bad++;
+  }
+  return bad;
+}
+
+
+int check_philox(){
+  // known answer from the Random123 distribution, philox4x32_10
+  uint32_t ctr[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+  uint32_t key[2] = {0xa4093822, 0x299f31d0};
+  uint32_t out[4];
+  Philox::block(ctr, key, out);
+  return (out[0]==0xd16cfe09 && out[1]==0x94fdcceb && out[2]==0x5001e420 && out[3]==0x24126ea1);
+}
+
+
+double check_wentzel(){
+  WentzelTable table;
+  return table.maxError(); // tabulated vs analytic cos(theta)
+}
+
+
+double check_gridmap(){
+  ComsolFields* fem = new ComsolFields("../data/sntracker_driftField.root");
+  fem->read_fields();
+  KDTreeMap* kdmap = new KDTreeMap(fem);
+  GridMap* grid = new GridMap(kdmap, 0.1);
+  double xmin, xmax, ymin, ymax;
+  kdmap->bounds(xmin, xmax, ymin, ymax);
+  // on a grid node the bilinear value is the resampled one
+  double x = xmin + 20*grid->getStep();
+  double y = ymin + 30*grid->getStep();
+  double ex, ey, gx, gy;
+  kdmap->field(x, y, ex, ey);
+  grid->field(x, y, gx, gy);
+  delete grid;
+  delete kdmap;
+  return std::fabs(gx-ex) + std::fabs(gy-ey); // should be rounding only
+}
+
+
+double check_meshmap(){
+  // a linear field is reproduced exactly inside the node hull
+  Philox rng(3, 0, 0, 0);
+  std::vector<double> x, y, ex, ey;
+  for (int i=0;i<10000;i++) {
+    x.push_back(16.0*rng.Rndm());
+    y.push_back(-43.4*rng.Rndm());
+    ex.push_back(2.0*x.back() + 3.0*y.back() + 1.0);
+    ey.push_back(0.5*y.back() - x.back());
+  }
+  MeshMap mesh(x, y, ex, ey);
+  double maxdev = 0.0;
+  for (int i=0;i<10000;i++) {
+    double px = 1.0 + 14.0*rng.Rndm();
+    double py = -1.0 - 41.4*rng.Rndm();
+    double fx, fy;
+    mesh.field(px, py, fx, fy);
+    double dev = std::fabs(fx - 2.0*px - 3.0*py - 1.0) + std::fabs(fy - 0.5*py + px);
+    if (dev > maxdev) maxdev = dev;
+  }
+  return maxdev; // rounding only
+}
+
+
+int check_meshedge(){
+  // points on shared edges give the same field whichever
+  // side the previous query of the thread was on
+  std::vector<double> x, y, ex, ey;
+  for (int i=0;i<40;i++)
+    for (int j=0;j<40;j++) {
+      x.push_back(0.1*i + 0.003*(j%3));
+      y.push_back(-0.1*j);
+      ex.push_back(std::sin(3.0*x.back()) * y.back());
+      ey.push_back(std::cos(y.back()) * x.back() * x.back());
+    }
+  MeshMap mesh(x, y, ex, ey);
+  int bad = 0;
+  for (int i=1;i<38;i++)
+    for (int j=1;j<38;j++) {
+      double px = 0.1*i + 0.003*(j%3) + 0.0371; // on a row of nodes
+      double py = -0.1*j;
+      double ax, ay, bx, by, dummy;
+      mesh.field(px, py+1.e-3, dummy, dummy); // walk in from above
+      mesh.field(px, py, ax, ay);
+      mesh.field(px, py-1.e-3, dummy, dummy); // and from below
+      mesh.field(px, py, bx, by);
+      if (ax!=bx || ay!=by) bad++;
+    }
+  return bad;
+}
+
+
+int check_fieldcache(){
+  // round trip through the file, then a changed source invalidates it
+  const char* source = "fieldcache_source.txt";
+  const char* cname = "fieldcache_test.fmap";
+  std::ofstream(source) << "comsol";
+  std::vector<double> x(100), y(100), ex(100), ey(100);
+  for (int i=0;i<100;i++) {
+    x[i] = 0.1*i;
+    y[i] = -0.2*i;
+    ex[i] = 1.e3*i;
+    ey[i] = -1.e3*i;
+  }
+  std::vector<int> tris(12, 7);
+  double helpers[6] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+  if (!FieldCache::write(cname, source, x, y, ex, ey, tris, 1, helpers)) return 1;
+  int bad = 0;
+  {
+    FieldCache fc(cname, source);
+    if (!fc.valid() || fc.nodes()!=100 || fc.triangles()!=2 || fc.triangleStart()!=1) return 2;
+    for (int i=0;i<100;i++)
+      if (fc.x()[i]!=x[i] || fc.y()[i]!=y[i] || fc.ex()[i]!=ex[i] || fc.ey()[i]!=ey[i]) bad++;
+    if (fc.triangleData()[11]!=7 || fc.helpers()[5]!=6.0) bad++;
+  }
+  std::ofstream(source) << "comsol, new run"; // other size
+  FieldCache stale(cname, source);
+  if (stale.valid()) bad++;
+  std::remove(source);
+  std::remove(cname);
+  return bad;
+}
+
+
+int check_comsoltext(){
+  // chunked parsing matches one thread, header and comments skipped
+  const char* text = "comsol_test.csv";
+  {
+    std::ofstream out(text);
+    for (int i=0;i<9;i++) out << "% Model: header " << i << std::endl;
+    for (int i=0;i<1000;i++) {
+      if (i==500) out << "% comment inside" << std::endl;
+      out << 1.e-3*i << "," << -2.e-3*i << "," << 10.0*i << "," << -5.0*i << std::endl;
+    }
+  }
+  std::vector<double> x, y, ex, ey, px, py, pex, pey;
+  if (!read_comsol_text(text, 1, 9, x, y, ex, ey) || x.size()!=1000) return 1;
+  if (!read_comsol_text(text, 7, 9, px, py, pex, pey)) return 2;
+  std::remove(text);
+  if (px!=x || py!=y || pex!=ex || pey!=ey) return 3;
+  return (std::fabs(x[999] - 99.9) < 1.e-9 && ey[999] == -4995.0) ? 0 : 4; // [cm], [V/m]
+}
+
+
+// linear test field, bilinear cells reproduce it
+class LinearField : public FieldMap {
+ public:
+  void field(double x, double y, double& ex, double& ey) {ex = 2.0*x + 1.0; ey = 3.0*y - x;}
+  size_t memory() {return 0;}
+};
+
+
+double check_quadtree(){
+  LinearField lin;
+  std::vector<wire_t> wl(1);
+  wl[0].x = 3.6; // anode wire at the default start
+  wl[0].y = -2.9;
+  wl[0].r = 0.002;
+  QuadTreeMap qt(&lin, 0.0, 16.0, -43.4, 0.0, wl);
+  if (qt.getDepth() < 12) return 1.0; // not refined down to the wire
+  double ex, ey;
+  qt.field(3.61, -2.9, ex, ey);
+  return std::fabs(ex - 2.0*3.61 - 1.0) + std::fabs(ey + 3.0*2.9 + 3.61);
+}
+
+
+int check_tilemap(){
+  // tiles reproduce the linear field under a one tile budget,
+  // every query is counted as a hit or a miss
+  const char* source = "tilemap_source.txt";
+  const char* tname = "tilemap_test.ftile";
+  std::ofstream(source) << "comsol";
+  LinearField lin;
+  if (!TileMap::write(tname, source, &lin, 0.0, 16.0, -43.4, 0.0, 0.05, 0.05, 64, 1000.0)) return 1;
+  if (!TileMap::current(tname, source, 0.05, 64) || TileMap::current(tname, source, 0.1, 64)) return 2;
+  TileMap tiles(tname, 2000.0, 0.0); // twice the bias, minimal budget
+  Philox rng(5, 0, 0, 0);
+  double maxdev = 0.0;
+  int n = 10000;
+  for (int i=0;i<n;i++) {
+    double x = 16.0*rng.Rndm();
+    double y = -43.4*rng.Rndm();
+    double ex, ey;
+    tiles.field(x, y, ex, ey);
+    double dev = std::fabs(ex - 2.0*(2.0*x + 1.0)) + std::fabs(ey - 2.0*(3.0*y - x));
+    if (dev > maxdev) maxdev = dev;
+  }
+  unsigned long long hits, misses, evictions;
+  tiles.tileStats(hits, misses, evictions);
+  // a file cut short is neither current nor opened
+  const char* shortname = "tilemap_short.ftile";
+  {
+    std::ifstream in(tname, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(shortname, std::ios::binary).write(bytes.data(), bytes.size()/2);
+  }
+  bool shortcurrent = TileMap::current(shortname, source, 0.05, 64);
+  bool shortvalid = TileMap(shortname, 1000.0, 0.0).valid();
+  std::remove(shortname);
+  std::remove(source);
+  std::remove(tname);
+  if (maxdev > 1.e-9 || hits + misses != (unsigned long long)n) return 3;
+  if (evictions + 1 != misses || tiles.memory() > 2*65*65*8 + 4096 + tiles.tiles()*sizeof(int)) return 4;
+  if (shortcurrent || shortvalid) return 5;
+  return 0;
+}
+
+
+double check_lazygrid(){
+  // tiles filled concurrently by pool threads, all exact for a linear field
+  std::shared_ptr<FieldMap> lin(new LinearField());
+  LazyGridMap lazy(lin, 0.0, 16.0, -43.4, 0.0, 0.01);
+  if (lazy.built()!=0) return 1.0;
+  thread_pool* pool = new thread_pool(4);
+  std::vector<thread_pool::future<double> > results;
+  for (int t=0;t<4;t++)
+    results.push_back(pool->async(std::function<double(int)>([&lazy](int seed) {
+	  Philox rng(6, seed, 0, 0);
+	  double maxdev = 0.0;
+	  for (int i=0;i<20000;i++) {
+	    double x = 16.0*rng.Rndm();
+	    double y = -43.4*rng.Rndm();
+	    double ex, ey;
+	    lazy.field(x, y, ex, ey);
+	    maxdev = std::max(maxdev, std::fabs(ex - 2.0*x - 1.0) + std::fabs(ey - 3.0*y + x));
+	  }
+	  return maxdev;
+	}), t));
+  double maxdev = 0.0;
+  for (thread_pool::future<double>& r : results) maxdev = std::max(maxdev, r.get());
+  delete pool;
+  if (lazy.built() < 1 || lazy.built() > lazy.tiles()) return 1.0;
+  return maxdev; // rounding only
+}
+
+
+double check_compactgrid(){
+  // float exact to rounding for a linear field, 16 bit
+  // within half a unit of the largest value in the tile;
+  // tiles row by row give the same values as along the curve
+  LinearField lin;
+  CompactGridMap fgrid(&lin, 0.0, 16.0, -43.4, 0.0, 0.05, storage_float);
+  CompactGridMap rgrid(&lin, 0.0, 16.0, -43.4, 0.0, 0.05, storage_float, false);
+  CompactGridMap qgrid(&lin, 0.0, 16.0, -43.4, 0.0, 0.05, storage_int16);
+  if (qgrid.memory() > 0.6*fgrid.memory()) return 1.0; // half, plus the tile scales
+  Philox rng(7, 0, 0, 0);
+  double frel = 0.0;
+  double qrel = 0.0;
+  for (int i=0;i<10000;i++) {
+    double x = 16.0*rng.Rndm();
+    double y = -43.4*rng.Rndm();
+    double tx = 2.0*x + 1.0;
+    double ty = 3.0*y - x;
+    double peak = 150.0; // |ey| bound in the box
+    double ex, ey;
+    fgrid.field(x, y, ex, ey);
+    frel = std::max(frel, (std::fabs(ex-tx) + std::fabs(ey-ty)) / peak);
+    double rx, ry;
+    rgrid.field(x, y, rx, ry);
+    if (rx!=ex || ry!=ey) return 1.0;
+    qgrid.field(x, y, ex, ey);
+    qrel = std::max(qrel, (std::fabs(ex-tx) + std::fabs(ey-ty)) / peak);
+  }
+  if (frel > 1.e-6) return 1.0;
+  return qrel; // two components, each within 1/65534 of the tile peak
+}
+
+
+int check_spatialorder(){
+  // a permutation, and consecutive nodes end up close
+  Philox rng(11, 0, 0, 0);
+  std::vector<double> x, y;
+  for (int i=0;i<10000;i++) {
+    x.push_back(16.0*rng.Rndm());
+    y.push_back(-43.4*rng.Rndm());
+  }
+  std::vector<int> order = spatial_order(x, y);
+  std::vector<int> sorted(order);
+  std::sort(sorted.begin(), sorted.end());
+  for (int i=0;i<10000;i++)
+    if (sorted[i] != i) return 1;
+  std::vector<double> cx(x), cy(y);
+  reorder(cx, order);
+  reorder(cy, order);
+  if (cx[17] != x[order[17]] || cy[17] != y[order[17]]) return 2;
+  double before = 0.0, after = 0.0;
+  for (int i=1;i<10000;i++) {
+    before += std::hypot(x[i]-x[i-1], y[i]-y[i-1]);
+    after += std::hypot(cx[i]-cx[i-1], cy[i]-cy[i-1]);
+  }
+  if (after > 0.1*before) return 3;
+  return 0;
+}
+
+int check_region(){
+  // wire lattice classifier against TGeo on a dense scan,
+  // whole box coarse and fine around the default anode wire
+  const char* gfname = "../data/trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname);
+  int wire;
+  int mismatch = 0;
+  for (int i=0;i<=400;i++)
+    for (int j=0;j<=400;j++) {
+      double x = -0.2 + 16.4 * i / 400.0;
+      double y = 0.2 - 43.8 * j / 400.0;
+      if (gmodel->region(x, y, 0.0, wire) != gmodel->whereami(x, y, 0.0)) mismatch++;
+    }
+  for (int i=0;i<=200;i++)
+    for (int j=0;j<=200;j++) {
+      double x = 3.6 + 0.006 * (i-100) / 100.0;
+      double y = -2.9 + 0.006 * (j-100) / 100.0;
+      if (gmodel->region(x, y, 0.0, wire) != gmodel->whereami(x, y, 0.0)) mismatch++;
+    }
+  delete gmodel;
+  return mismatch; // should be none
+}
+
+
+int check_distance(){
+  // a conservative distance never reaches past a boundary
+  const char* gfname = "../data/trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname);
+  Philox rng(4, 0, 0, 0);
+  int wire;
+  int violations = 0;
+  for (int n=0;n<100000;n++) {
+    double x = 16.0 * rng.Rndm();
+    double y = -43.4 * rng.Rndm();
+    double d = gmodel->distance(x, y, 0.0, wire);
+    if (d <= 0.0) continue;
+    for (int k=0;k<8;k++) { // the circle of radius d is all drift region
+      double phi = k * TMath::Pi() / 4.0;
+      if (gmodel->region(x + d*TMath::Cos(phi), y + d*TMath::Sin(phi), 0.0, wire) != 1) violations++;
+    }
+  }
+  delete gmodel;
+  return violations;
+}
+
+
+int check_navigators(){
+  // TGeo queries from pool threads, each on its own navigator
+  const char* gfname = "../data/trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname);
+  thread_pool* pool = new thread_pool(4);
+  std::vector<thread_pool::future<int> > results;
+  for (int t=0;t<4;t++)
+    results.push_back(pool->async(std::function<int(int)>([gmodel](int row) {
+	  int wire;
+	  int mismatch = 0;
+	  for (int j=row;j<400;j+=4)
+	    for (int i=0;i<400;i++) {
+	      double x = 3.6 + 0.006 * (i-200) / 200.0;
+	      double y = -2.9 + 0.006 * (j-200) / 200.0;
+	      if (gmodel->whereami(x, y, 0.0) != gmodel->region(x, y, 0.0, wire)) mismatch++;
+	    }
+	  return mismatch;
+	}), t));
+  int mismatch = 0;
+  for (thread_pool::future<int>& r : results) mismatch += r.get();
+  delete pool; // workers exit, their navigators go
+  delete gmodel;
+  return mismatch;
+}
+
+
+int check_navigatorslots(){
+  // more short lived pools than TGeo has thread slots: ended
+  // workers hand their slots back
+  const char* gfname = "../data/trackergeom.gdml";
+  GeometryModel* gmodel = new GeometryModel(gfname);
+  unsigned int lives = 2*gmodel->getThreads() + 4; // two workers each
+  int mismatch = 0;
+  for (unsigned int life=0;life<lives;life++) {
+    thread_pool* pool = new thread_pool(2);
+    std::vector<thread_pool::future<int> > results;
+    for (int t=0;t<2;t++)
+      results.push_back(pool->async(std::function<int(int)>([gmodel](int row) {
+	    int wire;
+	    int bad = 0;
+	    for (int i=0;i<50;i++) {
+	      double x = 3.6 + 0.006 * (i-25) / 25.0;
+	      double y = -2.9 + 0.003 * row;
+	      if (gmodel->whereami(x, y, 0.0) != gmodel->region(x, y, 0.0, wire)) bad++;
+	    }
+	    return bad;
+	  }), t));
+    for (thread_pool::future<int>& r : results) mismatch += r.get();
+    delete pool;
+  }
+  delete gmodel;
+  return mismatch;
+}
+
+
 TEST_CASE( "Geometry in", "[sndrift][geo_in]" ) {
   REQUIRE( check_geometry() == 1 );
 }
@@ -47,10 +685,106 @@ TEST_CASE( "Geometry wire", "[sndrift][wiretest]" ) {
   REQUIRE( check_wire() == -1 );
 }
 
+TEST_CASE( "Wire lattice", "[sndrift][regiontest]" ) {
+  REQUIRE( check_region() == 0 );
+}
+
+TEST_CASE( "Thread navigators", "[sndrift][navtest]" ) {
+  REQUIRE( check_navigators() == 0 );
+}
+
+TEST_CASE( "Navigator slots", "[sndrift][navslottest]" ) {
+  REQUIRE( check_navigatorslots() == 0 );
+}
+
+TEST_CASE( "Wire distance", "[sndrift][distancetest]" ) {
+  REQUIRE( check_distance() == 0 );
+}
+
 TEST_CASE( "Fields in", "[sndrift][fieldtest]" ) {
   REQUIRE( check_fields() == 258462 );
 }
 
+TEST_CASE( "Shared field map", "[sndrift][sharetest]" ) {
+  REQUIRE( check_sharedmap() == 0 );
+}
+
 TEST_CASE( "CS in", "[sndrift][cstest]" ) {
   REQUIRE( check_readcs() == 0.1664 );
 }
+
+TEST_CASE( "Energy bin lookup", "[sndrift][findbintest]" ) {
+  REQUIRE( check_findbin() == 0 );
+}
+
+TEST_CASE( "Majorant bound", "[sndrift][majoranttest]" ) {
+  REQUIRE( check_majorant() == 0 );
+}
+
+TEST_CASE( "Null collision flights", "[sndrift][flighttest]" ) {
+  REQUIRE( check_freeflight() < 0.02 );
+}
+
+TEST_CASE( "Collision channels", "[sndrift][channeltest]" ) {
+  REQUIRE( check_channels() == 0 );
+}
+
+TEST_CASE( "CS table", "[sndrift][cstabletest]" ) {
+  REQUIRE( check_cstable() == 0 );
+}
+
+TEST_CASE( "Pool tasks", "[sndrift][pooltest]" ) {
+  REQUIRE( check_pool() == 499500 );
+}
+
+TEST_CASE( "Thread count independence", "[sndrift][threadtest]" ) {
+  REQUIRE( check_threadcount() == 0 );
+}
+
+TEST_CASE( "RNG streams", "[sndrift][rngtest]" ) {
+  REQUIRE( check_philox() == 1 );
+}
+
+TEST_CASE( "Wentzel table", "[sndrift][angletest]" ) {
+  REQUIRE( check_wentzel() < 1.e-4 );
+}
+
+TEST_CASE( "Grid field map", "[sndrift][gridtest]" ) {
+  REQUIRE( check_gridmap() < 1.e-6 );
+}
+
+TEST_CASE( "Mesh field map", "[sndrift][meshtest]" ) {
+  REQUIRE( check_meshmap() < 1.e-9 );
+}
+
+TEST_CASE( "Mesh shared edges", "[sndrift][meshedgetest]" ) {
+  REQUIRE( check_meshedge() == 0 );
+}
+
+TEST_CASE( "Field cache", "[sndrift][cachetest]" ) {
+  REQUIRE( check_fieldcache() == 0 );
+}
+
+TEST_CASE( "COMSOL text", "[sndrift][comsoltest]" ) {
+  REQUIRE( check_comsoltext() == 0 );
+}
+
+TEST_CASE( "Quadtree field map", "[sndrift][quadtest]" ) {
+  REQUIRE( check_quadtree() < 1.e-9 );
+}
+
+TEST_CASE( "Tiled field map", "[sndrift][tiletest]" ) {
+  REQUIRE( check_tilemap() == 0 );
+}
+
+TEST_CASE( "Lazy grid field map", "[sndrift][lazytest]" ) {
+  REQUIRE( check_lazygrid() < 1.e-9 );
+}
+
+TEST_CASE( "Compact grid field map", "[sndrift][compacttest]" ) {
+  REQUIRE( check_compactgrid() < 4.e-5 );
+}
+
+TEST_CASE( "Spatial node order", "[sndrift][ordertest]" ) {
+  REQUIRE( check_spatialorder() == 0 );
+}
@@ -0,0 +1,79 @@
+// *********************************
+// SNDrift: COMSOL text export to the
+// binary field map read by ComsolFields
+//**********************************
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+// us
+#include "fieldcache.hh"
+#include "fieldmap.hh"
+#include "getopt_pp.h"
+
+void showHelp() {
+  std::cout << "COMSOL field converter command line option(s) help" << std::endl;
+  std::cout << "\t -i , --input <COMSOL csv export: x, y, ex, ey in [m], [V/m]>" << std::endl;
+  std::cout << "\t -o , --output <binary field map, give ComsolFields a .fmap name>" << std::endl;
+  std::cout << "\t -s , --skip <header lines before the data>" << std::endl;
+  std::cout << "\t -t , --threads <parsing threads, 0: all hardware threads>" << std::endl;
+}
+
+
+
+int main(int argc, char** argv) {
+  int skip, nthreads;
+  std::string input, output;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('i', "input", input, "sntracker.csv");
+  ops >> GetOpt::Option('o', "output", output, "data/sntracker_driftField.fmap");
+  ops >> GetOpt::Option('s', "skip", skip, 9); // as rootconverter2D.py
+  ops >> GetOpt::Option('t', "threads", nthreads, 0);
+
+  if (nthreads<=0) nthreads = std::thread::hardware_concurrency();
+  if (nthreads<=0) nthreads = 1;
+
+  std::vector<double> x, y, ex, ey;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (!read_comsol_text(input, nthreads, skip, x, y, ex, ey) || x.empty()) {
+    std::cout << "Error: no field nodes read from " << input << std::endl;
+    return 1;
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "parsed " << x.size() << " nodes on " << nthreads << " threads in [s] " << elapsed << std::endl;
+
+  // the index ComsolFields would otherwise build at every start,
+  // nodes along a Hilbert curve as ComsolFields keeps them
+  start = std::chrono::steady_clock::now();
+  std::vector<int> order = spatial_order(x, y);
+  reorder(x, order);
+  reorder(y, order);
+  reorder(ex, order);
+  reorder(ey, order);
+  MeshMap mesh(x, y, ex, ey);
+  std::vector<int> tris;
+  int tstart;
+  double helpers[6];
+  mesh.exportMesh(tris, tstart, helpers);
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "triangulated " << mesh.triangles() << " triangles in [s] " << elapsed << std::endl;
+
+  start = std::chrono::steady_clock::now();
+  if (!FieldCache::write(output, "", x, y, ex, ey, tris, tstart, helpers)) { // standalone
+    std::cout << "Error: cannot write " << output << std::endl;
+    return 1;
+  }
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "wrote " << output << " in [s] " << elapsed << std::endl;
+  return 0;
+}
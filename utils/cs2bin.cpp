@@ -0,0 +1,71 @@
+// *********************************
+// SNDrift: cross section table to the
+// binary format read by Ctransport
+//**********************************
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+// us
+#include "cscache.hh"
+#include "getopt_pp.h"
+
+void showHelp() {
+  std::cout << "cross section converter command line option(s) help" << std::endl;
+  std::cout << "\t -i , --input <ROOT file from cs2root.py or MagBoltz text file>" << std::endl;
+  std::cout << "\t -o , --output <binary table, give Ctransport a .csbin name>" << std::endl;
+}
+
+
+
+int main(int argc, char** argv) {
+  std::string input, output;
+  GetOpt::GetOpt_pp ops(argc, argv);
+
+  // Check for help request
+  if (ops >> GetOpt::OptionPresent('h', "help")){
+    showHelp();
+    return 0;
+  }
+
+  ops >> GetOpt::Option('i', "input", input, "data/trackergasCS.root");
+  ops >> GetOpt::Option('o', "output", output, "data/trackergasCS.csbin");
+
+  cs_table_t cs;
+  bool fromroot = (input.size()>5 && input.compare(input.size()-5, 5, ".root")==0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool ok = fromroot ? read_cs_root(input, cs) : read_cs_magboltz(input, cs);
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!ok || cs.energy.empty()) {
+    std::cout << "Error: no cross sections read from " << input << std::endl;
+    return 1;
+  }
+  std::cout << "read " << cs.energy.size() << " energy bins from " << input
+	    << " in [s] " << elapsed << std::endl;
+
+  if (!CSCache::write(output, "", cs)) { // standalone, no source check
+    std::cout << "Error: cannot write " << output << std::endl;
+    return 1;
+  }
+
+  // what a transport start costs now
+  start = std::chrono::steady_clock::now();
+  CSCache table(output, "");
+  cs_table_t back;
+  if (table.valid()) {
+    int n = table.bins();
+    back.energy.assign(table.energy(), table.energy()+n);
+    for (int g=0;g<3;g++) {
+      back.el[g].assign(table.elastic(g), table.elastic(g)+n);
+      back.inel[g].assign(table.inelastic(g), table.inelastic(g)+n);
+    }
+  }
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!table.valid() || back.el[2]!=cs.el[2] || back.inel[0]!=cs.inel[0]) {
+    std::cout << "Error: " << output << " does not read back" << std::endl;
+    return 1;
+  }
+  std::cout << "wrote " << output << ", read back in [s] " << elapsed << std::endl;
+  return 0;
+}